@@ -0,0 +1,457 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Benchmarks of all the models.
+//
+// Runs each compiled example (named after its source file, in --bin_dir) on a
+// fixed set of cases, with warm-up runs and repetitions, and reads what the
+// example prints: elapsed time, number of solutions, tour cost, and the
+// branches and failures printed with --telemetry. The counters of each case
+// are compared against --baseline, and its median and p95 times against
+// --timings.
+//
+// The counters do not depend on the machine, so the baseline is checked in
+// and rewritten with --update_counters when a change of the search is meant to
+// change them. A case regresses if it finds a different number of solutions or
+// a worse tour than the baseline, if its branches or failures grow by more
+// than --counter_tolerance, if it does not print a counter the baseline has,
+// or if it prints a counter the baseline does not have, so that a case cannot
+// pass unchecked. A counter is only left unchecked if the baseline says so
+// with "-", which is reported with the result.
+//
+// The timings depend on the machine, so they are kept out of the repository:
+// record them on the deployment hardware with --update_baseline. A case then
+// regresses if its median or p95 time grows by more than --time_tolerance
+// (plus --time_slack milliseconds, to absorb noise on very short runs).
+//
+// The program exits with 1 if any case regresses.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ortools/base/commandlineflags.h"
+
+DEFINE_string(
+	bin_dir, ".",
+	"Directory with the compiled examples.");
+DEFINE_string(
+	baseline, "benchmarks/baseline.csv",
+	"Solutions, objectives, branches and failures the results are compared against.");
+DEFINE_string(
+	timings, "benchmarks/timings.csv",
+	"Median and p95 times the results are compared against, recorded on this machine.");
+DEFINE_bool(
+	update_baseline, false,
+	"Write the times to --timings instead of comparing against them.");
+DEFINE_bool(
+	update_counters, false,
+	"Write the counters to --baseline instead of comparing against them.");
+DEFINE_string(
+	results_file, "",
+	"File all the results are written to, counters and times.");
+DEFINE_string(
+	filter, "",
+	"Only run the cases whose name contains this string.");
+DEFINE_int32(
+	warmup, 1,
+	"Number of runs of each case before the measured ones.");
+DEFINE_int32(
+	repetitions, 5,
+	"Number of measured runs of each case.");
+DEFINE_double(
+	time_tolerance, 0.15,
+	"Relative growth of the median or p95 time that counts as a regression.");
+DEFINE_int64(
+	time_slack, 5,
+	"Growth of the median or p95 time, in milliseconds, that is always tolerated.");
+DEFINE_double(
+	counter_tolerance, 0.0,
+	"Relative growth of the branches or failures that counts as a regression.");
+
+namespace operations_research {
+
+	struct BenchmarkCase {
+		std::string name;
+		std::string program;
+		std::string args;
+	};
+
+	const std::vector<BenchmarkCase> kBenchmarkCases = {
+		{ "nqueens_8", "nqueens-ortools", "--size=8 --telemetry --output_file=/dev/null" },
+		{ "nqueens_10", "nqueens-ortools", "--size=10 --telemetry --output_file=/dev/null" },
+		{ "nqueens_12", "nqueens-ortools", "--size=12 --telemetry --output_file=/dev/null" },
+		{ "nqueens_12_cpsat", "nqueens-ortools", "--size=12 --backend=cpsat --telemetry --output_file=/dev/null" },
+		{ "k4p2", "graceful-graphs/k4p2-graceful-graph", "--telemetry" },
+		{ "k4p2_v2", "graceful-graphs/k4p2-graceful-graph-v2", "--telemetry" },
+		{ "k4p2_v3", "graceful-graphs/k4p2-graceful-graph-v3", "--telemetry" },
+		{ "k4p2_v4", "graceful-graphs/k4p2-graceful-graph-v4", "--telemetry" },
+		{ "k4p2_cp", "graceful-graphs/k4p2-graceful-graph-ortools", "--backend=cp --telemetry --output_file=/dev/null" },
+		{ "k4p2_dlx", "graceful-graphs/k4p2-graceful-graph-ortools", "--backend=dlx --telemetry --output_file=/dev/null" },
+		{ "k3p3_dlx", "graceful-graphs/k4p2-graceful-graph-ortools",
+			"--backend=dlx --clique_size=3 --path_length=3 --telemetry --output_file=/dev/null" },
+		{ "tsp_13", "simple-tsp", "--telemetry" },
+		{ "tsp_random_100", "simple-tsp", "--random_cities=100 --seed=1 --telemetry" },
+		{ "tsp_random_200", "simple-tsp", "--random_cities=200 --seed=2 --telemetry" },
+		{ "tsp_decompose_20000", "simple-tsp", "--random_cities=20000 --seed=3 --decompose" } };
+
+	// What one case printed; -1 for what it did not print.
+	struct BenchmarkResult {
+		std::string name;
+		double medianMs = -1;
+		double p95Ms = -1;
+		int64 solutions = -1;
+		int64 objective = -1;
+		int64 branches = -1;
+		int64 failures = -1;
+		// Counters marked "-" in the baseline
+		std::set<std::string> unchecked;
+	};
+
+	// Reads the number after prefix if the line starts with it. A line with
+	// the prefix but no number leaves value as it was.
+	bool parseValue(const std::string& line, const std::string& prefix, int64* value) {
+		if (line.compare(0, prefix.size(), prefix) != 0) {
+			return false;
+		}
+		const char* const begin = line.c_str() + prefix.size();
+		char* end = nullptr;
+		const long long parsed = std::strtoll(begin, &end, 10);
+		if (end == begin) {
+			return false;
+		}
+		*value = parsed;
+		return true;
+	}
+
+	// Runs the case once. The examples wait for a key at the end, so their
+	// standard input is empty.
+	bool runOnce(const BenchmarkCase& benchmark, double* timeMs, BenchmarkResult* result) {
+		const std::string command = FLAGS_bin_dir + "/" + benchmark.program + " " + benchmark.args +
+			" < /dev/null 2> /dev/null";
+
+		const auto start = std::chrono::steady_clock::now();
+		FILE* const pipe = popen(command.c_str(), "r");
+		if (pipe == nullptr) {
+			return false;
+		}
+		std::string output;
+		char buffer[4096];
+		while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+			output += buffer;
+		}
+		const int status = pclose(pipe);
+		const std::chrono::duration<double, std::milli> processTime = std::chrono::steady_clock::now() - start;
+		if (status != 0) {
+			return false;
+		}
+
+		// The solver's own time if the example prints it, the process time otherwise
+		int64 elapsed = -1;
+		std::istringstream lines(output);
+		std::string line;
+		while (std::getline(lines, line)) {
+			parseValue(line, "Total elapsed time: ", &elapsed);
+			parseValue(line, "Total number of solutions: ", &result->solutions);
+			parseValue(line, "Total cost: ", &result->objective);
+			parseValue(line, "Total number of branches: ", &result->branches);
+			parseValue(line, "Total number of failures: ", &result->failures);
+		}
+		*timeMs = elapsed >= 0 ? elapsed : processTime.count();
+		return true;
+	}
+
+	// Nearest-rank percentile of sorted values
+	double percentile(const std::vector<double>& sorted, double p) {
+		const int rank = static_cast<int>(std::ceil(p * sorted.size()));
+		return sorted[std::max(rank, 1) - 1];
+	}
+
+	bool runCase(const BenchmarkCase& benchmark, BenchmarkResult* result) {
+		result->name = benchmark.name;
+		double timeMs = 0;
+		for (int i = 0; i < FLAGS_warmup; i++) {
+			if (!runOnce(benchmark, &timeMs, result)) {
+				return false;
+			}
+		}
+
+		std::vector<double> times;
+		for (int i = 0; i < std::max(1, FLAGS_repetitions); i++) {
+			if (!runOnce(benchmark, &timeMs, result)) {
+				return false;
+			}
+			times.push_back(timeMs);
+		}
+		std::sort(times.begin(), times.end());
+		result->medianMs = times.size() % 2 == 1 ? times[times.size() / 2] :
+			(times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+		result->p95Ms = percentile(times, 0.95);
+		return true;
+	}
+
+	const std::vector<std::string> kCounterColumns = { "solutions", "objective", "branches", "failures" };
+	const std::vector<std::string> kTimingColumns = { "median_ms", "p95_ms" };
+
+	// Value of a column of the result files; -1 for an unknown column.
+	double getField(const BenchmarkResult& result, const std::string& column) {
+		const std::map<std::string, double> fields = {
+			{ "solutions", result.solutions }, { "objective", result.objective },
+			{ "branches", result.branches }, { "failures", result.failures },
+			{ "median_ms", result.medianMs }, { "p95_ms", result.p95Ms } };
+		const auto it = fields.find(column);
+		return it == fields.end() ? -1 : it->second;
+	}
+
+	void setField(BenchmarkResult* result, const std::string& column, double value) {
+		const std::map<std::string, double*> doubles = {
+			{ "median_ms", &result->medianMs }, { "p95_ms", &result->p95Ms } };
+		const std::map<std::string, int64*> counters = {
+			{ "solutions", &result->solutions }, { "objective", &result->objective },
+			{ "branches", &result->branches }, { "failures", &result->failures } };
+		if (doubles.count(column) > 0) {
+			*doubles.at(column) = value;
+		}
+		else if (counters.count(column) > 0) {
+			*counters.at(column) = static_cast<int64>(value);
+		}
+	}
+
+	// Adds the columns of a CSV file with a "case" column and a header line to
+	// results. A missing file adds nothing; "-" marks a counter as unchecked.
+	void readResults(const std::string& filename, std::map<std::string, BenchmarkResult>* results) {
+		std::ifstream in(filename);
+		std::string line;
+		std::vector<std::string> columns;
+		auto split = [](const std::string& line) {
+			std::vector<std::string> fields;
+			std::istringstream row(line);
+			std::string field;
+			while (std::getline(row, field, ',')) {
+				fields.push_back(field);
+			}
+			return fields;
+		};
+		if (std::getline(in, line)) {
+			columns = split(line);
+		}
+		const int numColumns = columns.size();
+		while (std::getline(in, line)) {
+			std::vector<std::string> fields = split(line);
+			fields.resize(numColumns);
+			std::string name;
+			for (int i = 0; i < numColumns; i++) {
+				if (columns[i] == "case") {
+					name = fields[i];
+				}
+			}
+			if (name.empty()) {
+				continue;
+			}
+			BenchmarkResult& result = (*results)[name];
+			result.name = name;
+			for (int i = 0; i < numColumns; i++) {
+				if (columns[i] == "case" || fields[i].empty()) {
+					continue;
+				}
+				if (fields[i] == "-") {
+					result.unchecked.insert(columns[i]);
+					continue;
+				}
+				char* end = nullptr;
+				const double value = std::strtod(fields[i].c_str(), &end);
+				if (end != fields[i].c_str()) {
+					setField(&result, columns[i], value);
+				}
+			}
+		}
+	}
+
+	bool writeResults(const std::string& filename, const std::vector<std::string>& columns,
+		const std::vector<BenchmarkResult>& results) {
+		std::ofstream out(filename, std::ios::trunc);
+		out << std::fixed << std::setprecision(0);
+		out << "case";
+		for (const std::string& column : columns) {
+			out << "," << column;
+		}
+		out << "\n";
+		for (const BenchmarkResult& result : results) {
+			out << result.name;
+			for (const std::string& column : columns) {
+				out << ",";
+				const double value = getField(result, column);
+				if (value >= 0) {
+					out << value;
+				}
+				else if (result.unchecked.count(column) > 0) {
+					out << "-";
+				}
+			}
+			out << "\n";
+		}
+		return static_cast<bool>(out);
+	}
+
+	// Replaces the given results in filename, keeping the cases left out by
+	// --filter, in the order of kBenchmarkCases.
+	bool updateResults(const std::string& filename, const std::vector<std::string>& columns,
+		const std::vector<BenchmarkResult>& results) {
+		std::map<std::string, BenchmarkResult> updated;
+		readResults(filename, &updated);
+		for (const BenchmarkResult& result : results) {
+			updated[result.name] = result;
+		}
+		std::vector<BenchmarkResult> merged;
+		for (const BenchmarkCase& benchmark : kBenchmarkCases) {
+			if (updated.count(benchmark.name) > 0) {
+				merged.push_back(updated[benchmark.name]);
+			}
+		}
+		if (!writeResults(filename, columns, merged)) {
+			std::cout << "Could not write " << filename << "\n";
+			return false;
+		}
+		std::cout << "Written to " << filename << "\n";
+		return true;
+	}
+
+	// Returns why the result regresses from the baseline, or an empty string.
+	std::string regression(const BenchmarkResult& result, const BenchmarkResult& baseline) {
+		std::ostringstream why;
+		for (const std::string& column : kCounterColumns) {
+			if (baseline.unchecked.count(column) > 0) {
+				continue;
+			}
+			if (getField(result, column) >= 0 && getField(baseline, column) < 0) {
+				why << " " << column << " not in the baseline;";
+			}
+			if (getField(result, column) < 0 && getField(baseline, column) >= 0) {
+				why << " " << column << " not printed;";
+			}
+		}
+		if (baseline.solutions >= 0 && result.solutions >= 0 && result.solutions != baseline.solutions) {
+			why << " solutions " << result.solutions << " != " << baseline.solutions << ";";
+		}
+		if (baseline.objective >= 0 && result.objective > baseline.objective) {
+			why << " cost " << result.objective << " > " << baseline.objective << ";";
+		}
+		const double counterFactor = 1 + FLAGS_counter_tolerance;
+		if (baseline.branches >= 0 && result.branches > baseline.branches * counterFactor) {
+			why << " branches " << result.branches << " > " << baseline.branches << ";";
+		}
+		if (baseline.failures >= 0 && result.failures > baseline.failures * counterFactor) {
+			why << " failures " << result.failures << " > " << baseline.failures << ";";
+		}
+		// Times are only checked once they have been recorded on this machine
+		const double timeFactor = 1 + FLAGS_time_tolerance;
+		if (baseline.medianMs >= 0 && result.medianMs > baseline.medianMs * timeFactor + FLAGS_time_slack) {
+			why << " median " << result.medianMs << " ms > " << baseline.medianMs << " ms;";
+		}
+		if (baseline.p95Ms >= 0 && result.p95Ms > baseline.p95Ms * timeFactor + FLAGS_time_slack) {
+			why << " p95 " << result.p95Ms << " ms > " << baseline.p95Ms << " ms;";
+		}
+		return why.str();
+	}
+
+	int benchmarks() {
+		std::map<std::string, BenchmarkResult> baseline;
+		readResults(FLAGS_baseline, &baseline);
+		readResults(FLAGS_timings, &baseline);
+		std::vector<BenchmarkResult> results;
+		bool regressed = false;
+		const bool updating = FLAGS_update_baseline || FLAGS_update_counters;
+
+		std::cout << std::fixed << std::setprecision(1);
+		for (const BenchmarkCase& benchmark : kBenchmarkCases) {
+			if (benchmark.name.find(FLAGS_filter) == std::string::npos) {
+				continue;
+			}
+
+			BenchmarkResult result;
+			if (!runCase(benchmark, &result)) {
+				std::cout << benchmark.name << ": FAILED to run " << benchmark.program << "\n";
+				regressed = true;
+				continue;
+			}
+			results.push_back(result);
+
+			std::cout << benchmark.name << ": median " << result.medianMs << " ms, p95 "
+				<< result.p95Ms << " ms";
+			if (result.branches >= 0) {
+				std::cout << ", " << result.branches << " branches";
+			}
+			if (result.failures >= 0) {
+				std::cout << ", " << result.failures << " failures";
+			}
+
+			const auto it = baseline.find(benchmark.name);
+			if (updating) {
+				std::cout << "\n";
+			}
+			else if (it == baseline.end()) {
+				std::cout << " REGRESSION: not in the baseline\n";
+				regressed = true;
+			}
+			else {
+				const std::string why = regression(result, it->second);
+				std::cout << (why.empty() ? " OK" : " REGRESSION:" + why);
+				std::string separator = " (";
+				for (const std::string& column : it->second.unchecked) {
+					std::cout << separator << column;
+					separator = ", ";
+				}
+				if (!it->second.unchecked.empty()) {
+					std::cout << " unchecked)";
+				}
+				std::cout << "\n";
+				regressed = regressed || !why.empty();
+			}
+		}
+
+		if (!FLAGS_results_file.empty()) {
+			std::vector<std::string> columns = kCounterColumns;
+			columns.insert(columns.end(), kTimingColumns.begin(), kTimingColumns.end());
+			if (!writeResults(FLAGS_results_file, columns, results)) {
+				std::cout << "Could not write " << FLAGS_results_file << "\n";
+			}
+		}
+		if (updating) {
+			if (FLAGS_update_counters && !updateResults(FLAGS_baseline, kCounterColumns, results)) {
+				return 1;
+			}
+			if (FLAGS_update_baseline && !updateResults(FLAGS_timings, kTimingColumns, results)) {
+				return 1;
+			}
+			return 0;
+		}
+		return regressed ? 1 : 0;
+	}
+
+} // namespace operations_research
+
+int main(int argc, char** argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	return operations_research::benchmarks();
+} // main
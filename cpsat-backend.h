@@ -0,0 +1,116 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Small helpers to write the models of this repository as CP-SAT models.
+//
+// Variables are referred to by their index in the CpModelProto, and the
+// negation of variable i by -i - 1, as in the CP-SAT protos.
+
+#ifndef CPSAT_BACKEND_H
+#define CPSAT_BACKEND_H
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "ortools/sat/cp_model.pb.h"
+#include "ortools/sat/cp_model_solver.h"
+#include "ortools/sat/model.h"
+#include "ortools/sat/sat_parameters.pb.h"
+
+namespace operations_research {
+
+	// Adds an integer variable with domain [lb, ub] and returns its index.
+	inline int addSatVar(sat::CpModelProto* cpModel, int64 lb, int64 ub) {
+		const int index = cpModel->variables_size();
+		sat::IntegerVariableProto* const var = cpModel->add_variables();
+		var->add_domain(lb);
+		var->add_domain(ub);
+		return index;
+	}
+
+	// target == var + offset
+	inline void addSatOffset(sat::CpModelProto* cpModel, int target, int var, int64 offset) {
+		sat::LinearConstraintProto* const linear = cpModel->add_constraints()->mutable_linear();
+		linear->add_vars(target);
+		linear->add_coeffs(1);
+		linear->add_vars(var);
+		linear->add_coeffs(-1);
+		linear->add_domain(offset);
+		linear->add_domain(offset);
+	}
+
+	// target == |a - b|, where a and b take values in [0, bound]
+	inline void addSatAbsDifference(sat::CpModelProto* cpModel, int target, int a, int b, int64 bound) {
+		const int difference = addSatVar(cpModel, -bound, bound);
+
+		sat::LinearConstraintProto* const linear = cpModel->add_constraints()->mutable_linear();
+		linear->add_vars(difference);
+		linear->add_coeffs(1);
+		linear->add_vars(a);
+		linear->add_coeffs(-1);
+		linear->add_vars(b);
+		linear->add_coeffs(1);
+		linear->add_domain(0);
+		linear->add_domain(0);
+
+		// |d| = max(d, -d)
+		sat::IntegerArgumentProto* const max = cpModel->add_constraints()->mutable_int_max();
+		max->set_target(target);
+		max->add_vars(difference);
+		max->add_vars(-difference - 1);
+	}
+
+	inline void addSatAllDifferent(sat::CpModelProto* cpModel, const std::vector<int>& vars) {
+		sat::AllDifferentConstraintProto* const allDifferent = cpModel->add_constraints()->mutable_all_diff();
+		for (int var : vars) {
+			allDifferent->add_vars(var);
+		}
+	}
+
+	// Solves the model with the given number of search workers and calls
+	// onSolution for every solution found. CP-SAT can only enumerate all the
+	// solutions with a single worker, so that mode ignores numWorkers (and says
+	// so).
+	inline sat::CpSolverResponse solveSat(const sat::CpModelProto& cpModel, int numWorkers,
+		bool allSolutions, const std::function<void(const sat::CpSolverResponse&)>& onSolution) {
+		sat::SatParameters parameters;
+		if (allSolutions) {
+			if (numWorkers > 1) {
+				std::cout << "Enumerating all the solutions with 1 worker instead of " << numWorkers << "\n";
+			}
+			parameters.set_enumerate_all_solutions(true);
+			parameters.set_num_search_workers(1);
+		}
+		else {
+			parameters.set_num_search_workers(std::max(1, numWorkers));
+		}
+
+		sat::Model model;
+		model.Add(sat::NewSatParameters(parameters));
+		model.Add(sat::NewFeasibleSolutionObserver(onSolution));
+		return sat::SolveCpModel(cpModel, &model);
+	}
+
+	// Prints the search statistics of a response in the format of
+	// TelemetryMonitor::printSummary. The conflicts of CP-SAT are its failures.
+	inline void printSatSummary(const sat::CpSolverResponse& response) {
+		std::cout << "Total number of branches: " << response.num_branches() << "\n";
+		std::cout << "Total number of failures: " << response.num_conflicts() << "\n";
+	}
+
+} // namespace operations_research
+
+#endif // CPSAT_BACKEND_H
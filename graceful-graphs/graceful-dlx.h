@@ -0,0 +1,366 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Enumeration of graceful labelings with dancing links.
+//
+// ExactCoverWithColors is Knuth's Algorithm C (TAOCP 7.2.2.1): exact cover
+// of the primary items, where secondary items may be shared by rows that give
+// them the same color. All the nodes live in one array and link to each other
+// by index, as in Knuth's implementation, so covering and uncovering walk
+// contiguous memory instead of chasing pointers. The item to branch on is the
+// primary item with the fewest rows left.
+//
+// A graceful labeling of a graph with m edges is an exact cover of
+//   primary items:   every edge, and every edge label 1..m,
+//   secondary items: every node, colored with its label, and every node
+//                    label 0..m, colored with the node that has it,
+// by the rows "edge (u, w) gets label k, with u = a and w = a + k" (and the
+// other way round). The colors keep the labels of a node consistent across
+// its edges, and the node labels distinct.
+
+#ifndef GRACEFUL_DLX_H
+#define GRACEFUL_DLX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace operations_research {
+
+	class ExactCoverWithColors {
+	public:
+		// Primary items are 0..numPrimary-1, secondary items follow them.
+		ExactCoverWithColors(int numPrimary, int numSecondary)
+			: numPrimary_(numPrimary), numItems_(numPrimary + numSecondary), numRows_(0),
+			items_(numItems_ + 2), nodes_(numItems_ + 2) {
+			// Primary items are listed after header 0, secondary items after
+			// header numItems_ + 1. Item i is items_[i + 1] and nodes_[i + 1].
+			for (int i = 0; i <= numItems_ + 1; i++) {
+				items_[i] = { i - 1, i + 1 };
+				nodes_[i] = { 0, i, i, 0 };
+			}
+			items_[0].left = numPrimary_;
+			items_[numPrimary_].right = 0;
+			items_[numPrimary_ + 1].left = numItems_ + 1;
+			items_[numItems_ + 1].right = numPrimary_ + 1;
+			// Spacer before the first row
+			nodes_.push_back({ 0, 0, 0, 0 });
+		}
+
+		// Adds a row covering the given (item, color) pairs. Primary items
+		// must have color 0, secondary items have color 0 (not shared) or a
+		// positive color. Returns the index of the row.
+		int addRow(const std::vector<std::pair<int, int>>& items) {
+			const int spacer = nodes_.size() - 1;
+			for (const std::pair<int, int>& item : items) {
+				const int header = item.first + 1;
+				const int node = nodes_.size();
+				nodes_.push_back({ header, nodes_[header].up, header, item.second });
+				nodes_[nodes_[header].up].down = node;
+				nodes_[header].up = node;
+				nodes_[header].top++;
+			}
+			nodes_[spacer].down = nodes_.size() - 1;
+			nodes_.push_back({ -(numRows_ + 1), spacer + 1, 0, 0 });
+			return numRows_++;
+		}
+
+		// Calls onSolution with the rows of every exact cover, until it
+		// returns false. Returns the number of covers found.
+		int64_t solve(const std::function<bool(const std::vector<int>&)>& onSolution) {
+			numSolutions_ = 0;
+			numBranches_ = 0;
+			stopped_ = false;
+			chosen_.clear();
+			rows_.clear();
+			search(onSolution);
+			return numSolutions_;
+		}
+
+		// Number of rows tried by the last solve()
+		int64_t numBranches() const { return numBranches_; }
+
+	private:
+		struct Item {
+			int left;
+			int right;
+		};
+
+		// top is the header of a row node, the number of rows of a header, and
+		// minus the number of rows so far of a spacer.
+		struct Node {
+			int top;
+			int up;
+			int down;
+			int color;
+		};
+
+		void search(const std::function<bool(const std::vector<int>&)>& onSolution) {
+			if (items_[0].right == 0) {
+				numSolutions_++;
+				rows_.clear();
+				for (int node : chosen_) {
+					while (nodes_[node].top > 0) {
+						node++;
+					}
+					rows_.push_back(-nodes_[node].top - 1);
+				}
+				stopped_ = !onSolution(rows_);
+				return;
+			}
+
+			// Minimum remaining values
+			int best = items_[0].right;
+			for (int i = items_[best].right; i != 0; i = items_[i].right) {
+				if (nodes_[i].top < nodes_[best].top) {
+					best = i;
+				}
+			}
+			if (nodes_[best].top == 0) {
+				return;
+			}
+
+			cover(best);
+			for (int row = nodes_[best].down; row != best && !stopped_; row = nodes_[row].down) {
+				numBranches_++;
+				chosen_.push_back(row);
+				for (int p = row + 1; p != row;) {
+					const int item = nodes_[p].top;
+					if (item <= 0) {
+						p = nodes_[p].up;
+					}
+					else {
+						commit(p, item);
+						p++;
+					}
+				}
+				search(onSolution);
+				for (int p = row - 1; p != row;) {
+					const int item = nodes_[p].top;
+					if (item <= 0) {
+						p = nodes_[p].down;
+					}
+					else {
+						uncommit(p, item);
+						p--;
+					}
+				}
+				chosen_.pop_back();
+			}
+			uncover(best);
+		}
+
+		void cover(int item) {
+			for (int p = nodes_[item].down; p != item; p = nodes_[p].down) {
+				hide(p);
+			}
+			items_[items_[item].left].right = items_[item].right;
+			items_[items_[item].right].left = items_[item].left;
+		}
+
+		void uncover(int item) {
+			items_[items_[item].left].right = item;
+			items_[items_[item].right].left = item;
+			for (int p = nodes_[item].up; p != item; p = nodes_[p].up) {
+				unhide(p);
+			}
+		}
+
+		// Removes the other nodes of the row of p from their items
+		void hide(int p) {
+			for (int q = p + 1; q != p;) {
+				const Node& node = nodes_[q];
+				if (node.top <= 0) {
+					q = node.up;
+				}
+				else if (node.color < 0) {
+					q++;
+				}
+				else {
+					nodes_[node.up].down = node.down;
+					nodes_[node.down].up = node.up;
+					nodes_[node.top].top--;
+					q++;
+				}
+			}
+		}
+
+		void unhide(int p) {
+			for (int q = p - 1; q != p;) {
+				const Node& node = nodes_[q];
+				if (node.top <= 0) {
+					q = node.down;
+				}
+				else if (node.color < 0) {
+					q--;
+				}
+				else {
+					nodes_[node.up].down = q;
+					nodes_[node.down].up = q;
+					nodes_[node.top].top++;
+					q--;
+				}
+			}
+		}
+
+		void commit(int p, int item) {
+			if (nodes_[p].color == 0) {
+				cover(item);
+			}
+			else if (nodes_[p].color > 0) {
+				purify(p);
+			}
+		}
+
+		void uncommit(int p, int item) {
+			if (nodes_[p].color == 0) {
+				uncover(item);
+			}
+			else if (nodes_[p].color > 0) {
+				unpurify(p);
+			}
+		}
+
+		// Keeps the rows that give the item of p the color of p, marking their
+		// nodes of that item as already checked (color -1), and hides the others
+		void purify(int p) {
+			const int color = nodes_[p].color;
+			const int item = nodes_[p].top;
+			for (int q = nodes_[item].down; q != item; q = nodes_[q].down) {
+				if (nodes_[q].color == color) {
+					nodes_[q].color = -1;
+				}
+				else {
+					hide(q);
+				}
+			}
+		}
+
+		void unpurify(int p) {
+			const int color = nodes_[p].color;
+			const int item = nodes_[p].top;
+			for (int q = nodes_[item].up; q != item; q = nodes_[q].up) {
+				if (nodes_[q].color < 0) {
+					nodes_[q].color = color;
+				}
+				else {
+					unhide(q);
+				}
+			}
+		}
+
+		const int numPrimary_;
+		const int numItems_;
+		int numRows_;
+		std::vector<Item> items_;
+		std::vector<Node> nodes_;
+		std::vector<int> chosen_;
+		std::vector<int> rows_;
+		int64_t numSolutions_ = 0;
+		int64_t numBranches_ = 0;
+		bool stopped_ = false;
+	};
+
+	// Edges of Km x Pn: n copies of the complete graph Km, copy l on the nodes
+	// l * m .. l * m + m - 1, each node joined to its image in the next copy.
+	inline std::vector<std::pair<int, int>> cliquePathEdges(int m, int n) {
+		std::vector<std::pair<int, int>> edges;
+		for (int layer = 0; layer < n; layer++) {
+			for (int i = 0; i < m; i++) {
+				for (int j = i + 1; j < m; j++) {
+					edges.push_back({ layer * m + i, layer * m + j });
+				}
+			}
+		}
+		for (int layer = 0; layer + 1 < n; layer++) {
+			for (int i = 0; i < m; i++) {
+				edges.push_back({ layer * m + i, (layer + 1) * m + i });
+			}
+		}
+		return edges;
+	}
+
+	// Calls onLabeling with the node labels of every graceful labeling of the
+	// graph, until it returns false, and returns the number of labelings found.
+	// Nodes without edges are left with label -1.
+	//
+	// The complement l -> m - l of a graceful labeling is graceful too, and
+	// exactly one of the two has label 0 on the first node of the edge labeled
+	// m. Only that one is searched for, and both are reported. A graph without
+	// edges has one labeling, with every node at -1, which is its own
+	// complement.
+	inline int64_t enumerateGracefulLabelings(int numNodes, const std::vector<std::pair<int, int>>& edges,
+		const std::function<bool(const std::vector<int>&)>& onLabeling, int64_t* numBranches = nullptr) {
+		const int numEdges = edges.size();
+		// Edge label k is item m - k, so that ties in the choice of the item to
+		// branch on go to the largest labels, which fit the fewest edges
+		const int edgeItem = numEdges;
+		const int nodeItem = 2 * numEdges;
+		const int nodeLabelItem = 2 * numEdges + numNodes;
+		ExactCoverWithColors dlx(2 * numEdges, numNodes + numEdges + 1);
+
+		// Node labels set by each row
+		struct Assignment {
+			int u;
+			int labelU;
+			int w;
+			int labelW;
+		};
+		std::vector<Assignment> assignments;
+		for (int e = 0; e < numEdges; e++) {
+			for (int k = 1; k <= numEdges; k++) {
+				for (int a = 0; a + k <= numEdges; a++) {
+					for (int orientation = 0; orientation < (k < numEdges ? 2 : 1); orientation++) {
+						const int u = orientation == 0 ? edges[e].first : edges[e].second;
+						const int w = orientation == 0 ? edges[e].second : edges[e].first;
+						dlx.addRow({ { edgeItem + e, 0 }, { numEdges - k, 0 },
+							{ nodeItem + u, a + 1 }, { nodeItem + w, a + k + 1 },
+							{ nodeLabelItem + a, u + 1 }, { nodeLabelItem + a + k, w + 1 } });
+						assignments.push_back({ u, a, w, a + k });
+					}
+				}
+			}
+		}
+
+		int64_t numLabelings = 0;
+		std::vector<int> labeling(numNodes);
+		dlx.solve([&](const std::vector<int>& rows) {
+			std::fill(labeling.begin(), labeling.end(), -1);
+			for (int row : rows) {
+				labeling[assignments[row].u] = assignments[row].labelU;
+				labeling[assignments[row].w] = assignments[row].labelW;
+			}
+			numLabelings++;
+			if (!onLabeling(labeling) || numEdges == 0) {
+				return false;
+			}
+			for (int& label : labeling) {
+				if (label >= 0) {
+					label = numEdges - label;
+				}
+			}
+			numLabelings++;
+			return onLabeling(labeling);
+		});
+		if (numBranches != nullptr) {
+			*numBranches = dlx.numBranches();
+		}
+		return numLabelings;
+	}
+
+} // namespace operations_research
+
+#endif // GRACEFUL_DLX_H
@@ -12,15 +12,102 @@
 //See the License for the specific language governing permissions and
 //limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+#include "ortools/base/commandlineflags.h"
 #include "ortools/constraint_solver/constraint_solveri.h"
+#include "../cpsat-backend.h"
+#include "../search-checkpoint.h"
+#include "../search-racing.h"
+#include "../search-telemetry.h"
+#include "graceful-dlx.h"
+#include "labeling-store.h"
+
+DEFINE_bool(
+	race, false,
+	"Race the branching heuristics on short probes and search with the winner.");
+DEFINE_int64(
+	race_fail_limit, 1000,
+	"Failure limit of the first round of probes when racing.");
+DEFINE_int64(
+	race_time_limit, 1000,
+	"Time limit in milliseconds of each probe when racing.");
+DEFINE_string(
+	backend, "cp",
+	"Solver used for the model: cp (original constraint solver), cpsat or dlx (dancing links, see graceful-dlx.h).");
+DEFINE_int32(
+	clique_size, 4,
+	"m of the graph Km x Pn labeled by the dlx backend. The other backends only label K4 x P2.");
+DEFINE_int32(
+	path_length, 2,
+	"n of the graph Km x Pn labeled by the dlx backend.");
+DEFINE_bool(
+	cross_check, false,
+	"Enumerate with both the cp and the dlx backends and check that they find the same labelings.");
+DEFINE_int32(
+	workers, 8,
+	"Number of search workers of the cpsat backend.");
+DEFINE_bool(
+	all_solutions, true,
+	"Enumerate all the solutions. If false, stop at the first one.");
+DEFINE_string(
+	output_file, "",
+	"File the solutions are written to. If empty, they are written to the standard output.");
+DEFINE_string(
+	checkpoint_file, "",
+	"File the search is periodically checkpointed to. If empty, there are no checkpoints.");
+DEFINE_int64(
+	checkpoint_interval, 60000,
+	"Time in milliseconds between two checkpoints.");
+DEFINE_bool(
+	resume, false,
+	"Resume the search from --checkpoint_file, appending to --output_file.");
+DEFINE_string(
+	store_file, "",
+	"File the labelings found are stored to, up to symmetry (see labeling-store.h).");
+DEFINE_bool(
+	telemetry, false,
+	"Print search statistics at the end of the search.");
+DEFINE_string(
+	telemetry_file, "",
+	"File the search statistics are written to, as CSV if its name ends in .csv and as JSON otherwise.");
+DEFINE_int64(
+	telemetry_interval, 1000,
+	"Time in milliseconds between two samples of the search statistics.");
+DEFINE_string(
+	profile_file, "",
+	"File the propagation profile of each constraint is written to.");
 
 namespace operations_research {
 
-	void printSolutionArray(std::vector<IntVar*> arrayOfVars);
+	void printSolutionArray(std::vector<IntVar*> arrayOfVars, std::ostream& out = std::cout);
+	void printSatSolutionArray(const sat::CpSolverResponse& response, const std::vector<int>& vars,
+		std::ostream& out = std::cout);
+
+	// Edges of k4p2 as pairs of indices into allnodes (front nodes are 0 to 3,
+	// back nodes are 4 to 7), in the same order as the edges of gracefulGraph().
+	const int kNumNodes = 8;
+	const int kNumEdges = 16;
+	const int kEdges[kNumEdges][2] = {
+		{ 0, 1 }, { 0, 2 }, { 1, 3 }, { 2, 3 }, // Front
+		{ 0, 3 }, { 1, 2 },                     // Front diagonals
+		{ 4, 5 }, { 4, 6 }, { 5, 7 }, { 6, 7 }, // Back
+		{ 4, 7 }, { 5, 6 },                     // Back diagonals
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } }; // Connecting edges
+
+	// Returns the number of solutions, or -1 if the search could not start.
+	// If labelings is not null, the solutions are collected in it instead of
+	// being printed.
+	int64 gracefulGraph(std::vector<std::vector<int>>* labelings = nullptr) {
+		const bool telemetryEnabled = FLAGS_telemetry || !FLAGS_telemetry_file.empty();
+		TelemetryTimers timers;
+		TelemetryTimers* const sectionTimers = telemetryEnabled ? &timers : nullptr;
+		ScopedTimer modelTimer(sectionTimers, "model");
 
-	void gracefulGraph() {
 		// Instantiate the solver.
-		Solver solver("k4p2");
+		Solver solver("k4p2", telemetryParameters(!FLAGS_profile_file.empty()));
 		const int64 numEdges = 16;
 
 		// Create nodes
@@ -73,6 +160,8 @@ namespace operations_research {
 		// The labels of all the edges must be different
 		solver.AddConstraint(solver.MakeAllDifferent(edges));
 
+		modelTimer.stop();
+
 		std::vector<IntVar*> allvars;
 
 		allvars.insert(allvars.end(), edges.begin(), edges.end());
@@ -80,46 +169,324 @@ namespace operations_research {
 
 
 		// Branching heuristics
-		DecisionBuilder* const db1 = solver.MakePhase(allnodes,
+		DecisionBuilder* db1 = solver.MakePhase(allnodes,
 			Solver::CHOOSE_MAX_REGRET_ON_MIN,//CHOOSE_MIN_SIZE,
 			Solver::ASSIGN_MIN_VALUE);
 
+		// The race is not part of the search time
+		int64 raceTime = 0;
+		if (FLAGS_race) {
+			ScopedTimer raceTimer(sectionTimers, "race");
+			const int64 raceStart = solver.wall_time();
+			db1 = raceHeuristics(&solver, { { "allnodes", allnodes }, { "edges", edges } },
+				FLAGS_race_fail_limit, FLAGS_race_time_limit);
+			raceTime = solver.wall_time() - raceStart;
+			std::cout << "Race time: " << raceTime << " milliseconds.\n";
+		}
+
+		// Checkpoints
+		SearchCheckpoint checkpoint;
+		checkpoint.model = "k4p2";
+
+		if (FLAGS_resume) {
+			if (!readCheckpoint(FLAGS_checkpoint_file, &checkpoint) || checkpoint.model != "k4p2") {
+				std::cout << "No checkpoint of k4p2 in " << FLAGS_checkpoint_file << "\n";
+				return -1;
+			}
+			db1 = makeReplayPhase(&solver, allvars, checkpoint, db1);
+		}
+
+		std::ofstream outputFile;
+		if (!FLAGS_output_file.empty() &&
+			!openSolutionSink(FLAGS_output_file, FLAGS_resume ? &checkpoint : nullptr, &outputFile)) {
+			std::cout << "Could not open " << FLAGS_output_file << "\n";
+			return -1;
+		}
+		std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+
+		std::vector<SearchMonitor*> monitors;
+		if (!FLAGS_checkpoint_file.empty()) {
+			monitors.push_back(makeCheckpointMonitor(&solver, allvars, checkpoint, &outputFile,
+				FLAGS_checkpoint_file, FLAGS_checkpoint_interval));
+		}
+
+		TelemetryMonitor* telemetry = nullptr;
+		if (telemetryEnabled) {
+			telemetry = makeTelemetryMonitor(&solver, FLAGS_telemetry_interval);
+			monitors.push_back(telemetry);
+		}
+
 		// Search!
-		solver.Solve(db1);
+		ScopedTimer searchTimer(sectionTimers, "search");
+		solver.NewSearch(db1, monitors);
 
-		int numSolutions = 0;
+		int64 numSolutions = checkpoint.numSolutions;
+
+		std::vector<std::pair<int, int>> edgeList;
+		for (int i = 0; i < kNumEdges; i++) {
+			edgeList.push_back({ kEdges[i][0], kEdges[i][1] });
+		}
+		const LabelingSymmetries symmetries(kNumNodes, edgeList);
+		LabelingStoreWriter store(symmetries);
+		std::vector<int> labeling(kNumNodes);
 
 		// Print
 		while (solver.NextSolution()) {
 			numSolutions++;
-			std::cout << "Solution " << numSolutions << " :";
-			printSolutionArray(allnodes);
+			for (int i = 0; i < kNumNodes; i++) {
+				labeling[i] = allnodes[i]->Value();
+			}
+			if (labelings != nullptr) {
+				labelings->push_back(labeling);
+			}
+			else {
+				output << "Solution " << numSolutions << " :";
+				printSolutionArray(allnodes, output);
+			}
+			if (!FLAGS_store_file.empty()) {
+				store.add(labeling);
+			}
+			if (!FLAGS_all_solutions) {
+				break;
+			}
 		}
+		solver.EndSearch();
+		searchTimer.stop();
 
-		const int64 elapsedTime = solver.wall_time();
+		const int64 elapsedTime = solver.wall_time() - raceTime;
 
 		std::cout << "Total number of solutions: " << numSolutions << "\n";
 		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
 
+		if (telemetry != nullptr) {
+			telemetry->printSummary();
+			if (!FLAGS_telemetry_file.empty() && !telemetry->write(FLAGS_telemetry_file, &timers)) {
+				std::cout << "Could not write " << FLAGS_telemetry_file << "\n";
+			}
+		}
+		if (!FLAGS_profile_file.empty()) {
+			solver.ExportProfilingOverview(FLAGS_profile_file);
+		}
+
+		if (!FLAGS_store_file.empty()) {
+			const int64 numStored = store.write(FLAGS_store_file);
+			if (numStored < 0) {
+				std::cout << "Could not write " << FLAGS_store_file << "\n";
+			}
+			else {
+				std::cout << "Stored " << numStored << " labelings up to symmetry (group of size "
+					<< symmetries.size() << ") in " << FLAGS_store_file << "\n";
+			}
+		}
 
+		return numSolutions;
 	} // gracefulGraph
 
+	// Same model as gracefulGraph(), written for the CP-SAT solver
+	void gracefulGraphSat() {
+		sat::CpModelProto cpModel;
+
+		// Create nodes
+		std::vector<int> allnodes(kNumNodes);
+		for (int i = 0; i < kNumNodes; i++) {
+			allnodes[i] = addSatVar(&cpModel, 0, kNumEdges);
+		}
+
+		// The label of each node must be different
+		addSatAllDifferent(&cpModel, allnodes);
+
+		// Edges
+		std::vector<int> edges(kNumEdges);
+		for (int i = 0; i < kNumEdges; i++) {
+			edges[i] = addSatVar(&cpModel, 1, kNumEdges);
+			addSatAbsDifference(&cpModel, edges[i], allnodes[kEdges[i][0]], allnodes[kEdges[i][1]], kNumEdges);
+		}
+
+		// The labels of all the edges must be different
+		addSatAllDifferent(&cpModel, edges);
+
+		std::ofstream outputFile;
+		if (!FLAGS_output_file.empty() && !openSolutionSink(FLAGS_output_file, nullptr, &outputFile)) {
+			std::cout << "Could not open " << FLAGS_output_file << "\n";
+			return;
+		}
+		std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+
+		// Search!
+		int numSolutions = 0;
+		const sat::CpSolverResponse response = solveSat(cpModel, FLAGS_workers, FLAGS_all_solutions,
+			[&](const sat::CpSolverResponse& solution) {
+			numSolutions++;
+			output << "Solution " << numSolutions << " :";
+			printSatSolutionArray(solution, allnodes, output);
+		});
+
+		const int64 elapsedTime = static_cast<int64>(response.wall_time() * 1000);
+
+		std::cout << "Total number of solutions: " << numSolutions << "\n";
+		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
+
+		if (FLAGS_telemetry) {
+			printSatSummary(response);
+		}
+
+	} // gracefulGraphSat
+
+	// Enumerates the graceful labelings of Km x Pn with dancing links. The
+	// nodes of K4 x P2 are in the order of allnodes in gracefulGraph(). If
+	// labelings is not null, the solutions are collected in it instead of being
+	// printed.
+	int64 gracefulGraphDlx(std::vector<std::vector<int>>* labelings = nullptr) {
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const int numNodes = FLAGS_clique_size * FLAGS_path_length;
+		const std::vector<std::pair<int, int>> edges = cliquePathEdges(FLAGS_clique_size, FLAGS_path_length);
+
+		std::ofstream outputFile;
+		if (!FLAGS_output_file.empty() && !openSolutionSink(FLAGS_output_file, nullptr, &outputFile)) {
+			std::cout << "Could not open " << FLAGS_output_file << "\n";
+			return -1;
+		}
+		std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+
+		// Search!
+		int64 numSolutions = 0;
+		int64_t dlxBranches = 0;
+		enumerateGracefulLabelings(numNodes, edges, [&](const std::vector<int>& labeling) {
+			numSolutions++;
+			if (labelings != nullptr) {
+				labelings->push_back(labeling);
+				return FLAGS_all_solutions;
+			}
+			output << "Solution " << numSolutions << " :[ ";
+			for (int label : labeling) {
+				output << label << " ";
+			}
+			output << "]\n";
+			return FLAGS_all_solutions;
+		}, &dlxBranches);
+		const int64 numBranches = dlxBranches;
+
+		const int64 elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		std::cout << "Total number of solutions: " << numSolutions << "\n";
+		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
+		if (FLAGS_telemetry) {
+			std::cout << "Total number of branches: " << numBranches << "\n";
+		}
+
+		return numSolutions;
+	} // gracefulGraphDlx
+
 	  // Prints the values of a vector of IntVar between square brakets.
 	  // Elements of the vector are separated by white spaces.
-	void printSolutionArray(std::vector<IntVar*> arrayOfVars) {
+	void printSolutionArray(std::vector<IntVar*> arrayOfVars, std::ostream& out) {
 		int i = 0;
 		int size = arrayOfVars.size();
-		std::cout << "[ ";
+		out << "[ ";
 		while (i < size) {
-			std::cout << arrayOfVars[i]->Value() << " ";
+			out << arrayOfVars[i]->Value() << " ";
 			i++;
 		}
-		std::cout << "]\n";
+		out << "]\n";
+	}
+
+	// Same as printSolutionArray, for a solution of the CP-SAT solver
+	void printSatSolutionArray(const sat::CpSolverResponse& response, const std::vector<int>& vars,
+		std::ostream& out) {
+		out << "[ ";
+		for (int var : vars) {
+			out << response.solution(var) << " ";
+		}
+		out << "]\n";
 	}
 
 } // namespace operations_research
 
 int main(int argc, char** argv) {
-	operations_research::gracefulGraph();
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	if (FLAGS_resume && FLAGS_checkpoint_file.empty()) {
+		std::cout << "--resume needs --checkpoint_file\n";
+		return 1;
+	}
+	if (FLAGS_resume && !FLAGS_store_file.empty()) {
+		std::cout << "--store_file needs the whole enumeration and cannot be used with --resume\n";
+		return 1;
+	}
+	const bool k4p2 = FLAGS_clique_size == 4 && FLAGS_path_length == 2;
+	if (FLAGS_clique_size < 1 || FLAGS_path_length < 1) {
+		std::cout << "--clique_size and --path_length must be positive\n";
+		return 1;
+	}
+	if (FLAGS_clique_size == 1 && FLAGS_path_length == 1) {
+		std::cout << "K1 x P1 has no edges to label\n";
+		return 1;
+	}
+	if (!k4p2 && (FLAGS_backend != "dlx" || FLAGS_cross_check)) {
+		std::cout << "Only the dlx backend labels graphs other than K4 x P2\n";
+		return 1;
+	}
+	if (FLAGS_backend == "dlx" && (!FLAGS_checkpoint_file.empty() || !FLAGS_store_file.empty())) {
+		std::cout << "The dlx backend has no checkpoints and no store\n";
+		return 1;
+	}
+	if (FLAGS_backend == "cpsat" && (!FLAGS_checkpoint_file.empty() || FLAGS_resume ||
+		!FLAGS_store_file.empty() || !FLAGS_telemetry_file.empty() || !FLAGS_profile_file.empty() || FLAGS_race)) {
+		std::cout << "The cpsat backend has no checkpoints, store, telemetry or profile files, nor racing\n";
+		return 1;
+	}
+	if (FLAGS_cross_check) {
+		if (!FLAGS_all_solutions || FLAGS_resume) {
+			std::cout << "--cross_check needs the whole enumeration\n";
+			return 1;
+		}
+		if (!FLAGS_output_file.empty()) {
+			// Both backends would write their solutions to it
+			std::cout << "--cross_check cannot be used with --output_file\n";
+			return 1;
+		}
+		// Only the counts are printed; the labelings are compared as sets
+		std::vector<std::vector<int>> dlxLabelings;
+		std::vector<std::vector<int>> cpLabelings;
+		std::cout << "dlx backend:\n";
+		const int64 numDlx = operations_research::gracefulGraphDlx(&dlxLabelings);
+		std::cout << "cp backend:\n";
+		const int64 numCp = operations_research::gracefulGraph(&cpLabelings);
+		if (numDlx < 0 || numCp < 0) {
+			std::cout << "Cross-check failed: a backend could not search\n";
+			return 1;
+		}
+		std::sort(dlxLabelings.begin(), dlxLabelings.end());
+		std::sort(cpLabelings.begin(), cpLabelings.end());
+		std::vector<std::vector<int>> mismatches;
+		std::set_symmetric_difference(dlxLabelings.begin(), dlxLabelings.end(),
+			cpLabelings.begin(), cpLabelings.end(), std::back_inserter(mismatches));
+		if (numDlx != numCp || !mismatches.empty()) {
+			std::cout << "Cross-check failed: dlx found " << numDlx << " labelings, cp found " << numCp << "\n";
+			if (!mismatches.empty()) {
+				const bool inDlx = std::binary_search(dlxLabelings.begin(), dlxLabelings.end(), mismatches[0]);
+				std::cout << "First mismatch: [ ";
+				for (int label : mismatches[0]) {
+					std::cout << label << " ";
+				}
+				std::cout << "] found only by " << (inDlx ? "dlx" : "cp") << "\n";
+			}
+			return 1;
+		}
+		std::cout << "Cross-check passed: " << numDlx << " labelings\n";
+	}
+	else if (FLAGS_backend == "cpsat") {
+		operations_research::gracefulGraphSat();
+	}
+	else if (FLAGS_backend == "cp") {
+		operations_research::gracefulGraph();
+	}
+	else if (FLAGS_backend == "dlx") {
+		operations_research::gracefulGraphDlx();
+	}
+	else {
+		std::cout << "Unknown backend: " << FLAGS_backend << "\n";
+		return 1;
+	}
 	return 0;
 } // main
\ No newline at end of file
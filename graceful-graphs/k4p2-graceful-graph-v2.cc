@@ -12,7 +12,33 @@
 //See the License for the specific language governing permissions and
 //limitations under the License.
 
+#include "ortools/base/commandlineflags.h"
 #include "ortools/constraint_solver/constraint_solveri.h"
+#include "../search-checkpoint.h"
+#include "../search-racing.h"
+#include "../search-telemetry.h"
+
+DEFINE_bool(
+	race, false,
+	"Race the branching heuristics on short probes and search with the winner.");
+DEFINE_int64(
+	race_fail_limit, 1000,
+	"Failure limit of the first round of probes when racing.");
+DEFINE_int64(
+	race_time_limit, 1000,
+	"Time limit in milliseconds of each probe when racing.");
+DEFINE_string(
+	checkpoint_file, "",
+	"File the search is periodically checkpointed to. If empty, there are no checkpoints.");
+DEFINE_int64(
+	checkpoint_interval, 60000,
+	"Time in milliseconds between two checkpoints.");
+DEFINE_bool(
+	resume, false,
+	"Resume the search from --checkpoint_file.");
+DEFINE_bool(
+	telemetry, false,
+	"Print search statistics at the end of the search.");
 
 namespace operations_research {
 
@@ -86,15 +112,50 @@ namespace operations_research {
 			Solver::CHOOSE_MIN_SIZE,
 			Solver::ASSIGN_CENTER_VALUE);
 
-		DecisionBuilder* const db1 = solver.MakePhase(allnodes,
+		DecisionBuilder* db1 = solver.MakePhase(allnodes,
 			Solver::CHOOSE_FIRST_UNBOUND,//CHOOSE_MIN_SIZE,
 			Solver::ASSIGN_MIN_VALUE);
 
+		// The race is not part of the search time
+		int64 raceTime = 0;
+		if (FLAGS_race) {
+			const int64 raceStart = solver.wall_time();
+			db1 = raceHeuristics(&solver, { { "allnodes", allnodes }, { "edges", edges } },
+				FLAGS_race_fail_limit, FLAGS_race_time_limit);
+			raceTime = solver.wall_time() - raceStart;
+			std::cout << "Race time: " << raceTime << " milliseconds.\n";
+		}
+
+		// Checkpoints
+		SearchCheckpoint checkpoint;
+		checkpoint.model = "k4p2-v2";
+
+		if (FLAGS_resume) {
+			if (!readCheckpoint(FLAGS_checkpoint_file, &checkpoint) || checkpoint.model != "k4p2-v2") {
+				std::cout << "No checkpoint of k4p2-v2 in " << FLAGS_checkpoint_file << "\n";
+				return;
+			}
+			db1 = makeReplayPhase(&solver, allvars, checkpoint, db1);
+		}
+
+		std::vector<SearchMonitor*> monitors;
+		if (!FLAGS_checkpoint_file.empty()) {
+			monitors.push_back(makeCheckpointMonitor(&solver, allvars, checkpoint, nullptr,
+				FLAGS_checkpoint_file, FLAGS_checkpoint_interval));
+		}
+
+		// Only the summary is printed, so one sample per second is plenty
+		TelemetryMonitor* telemetry = nullptr;
+		if (FLAGS_telemetry) {
+			telemetry = makeTelemetryMonitor(&solver, 1000);
+			monitors.push_back(telemetry);
+		}
+
 		// Search!
 		//solver.Solve(db);
-		solver.Solve(db1);
+		solver.NewSearch(db1, monitors);
 
-		int numSolutions = 0;
+		int64 numSolutions = checkpoint.numSolutions;
 
 		// Print
 		while (solver.NextSolution()) {
@@ -102,12 +163,17 @@ namespace operations_research {
 			//std::cout << "Solution " << numSolutions << " :";
 			//printSolutionArray(allnodes);
 		}
+		solver.EndSearch();
 
-		const int64 elapsedTime = solver.wall_time();
+		const int64 elapsedTime = solver.wall_time() - raceTime;
 
 		std::cout << "Total number of solutions: " << numSolutions << "\n";
 		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
 
+		if (telemetry != nullptr) {
+			telemetry->printSummary();
+		}
+
 
 	} // gracefulGraph
 
@@ -127,6 +193,11 @@ namespace operations_research {
 } // namespace operations_research
 
 int main(int argc, char** argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	if (FLAGS_resume && FLAGS_checkpoint_file.empty()) {
+		std::cout << "--resume needs --checkpoint_file\n";
+		return 1;
+	}
 	operations_research::gracefulGraph();
 	getchar();
 	return 0;
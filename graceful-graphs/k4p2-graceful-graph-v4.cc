@@ -12,7 +12,33 @@
 //See the License for the specific language governing permissions and
 //limitations under the License.
 
+#include "ortools/base/commandlineflags.h"
 #include "ortools/constraint_solver/constraint_solveri.h"
+#include "../search-checkpoint.h"
+#include "../search-racing.h"
+#include "../search-telemetry.h"
+
+DEFINE_bool(
+	race, false,
+	"Race the branching heuristics on short probes and search with the winner.");
+DEFINE_int64(
+	race_fail_limit, 1000,
+	"Failure limit of the first round of probes when racing.");
+DEFINE_int64(
+	race_time_limit, 1000,
+	"Time limit in milliseconds of each probe when racing.");
+DEFINE_string(
+	checkpoint_file, "",
+	"File the search is periodically checkpointed to. If empty, there are no checkpoints.");
+DEFINE_int64(
+	checkpoint_interval, 60000,
+	"Time in milliseconds between two checkpoints.");
+DEFINE_bool(
+	resume, false,
+	"Resume the search from --checkpoint_file.");
+DEFINE_bool(
+	telemetry, false,
+	"Print search statistics at the end of the search.");
 
 namespace operations_research {
 
@@ -99,21 +125,62 @@ namespace operations_research {
 		solver.AddConstraint(solver.MakeLessOrEqual(edges[5], solver.MakeSum(edges[0], edges[1])));
 		solver.AddConstraint(solver.MakeLessOrEqual(edges[1], solver.MakeSum(edges[5], edges[0])));
 
+		// Every variable the search or the race may branch on, for the checkpoints
+		std::vector<IntVar*> allvars;
+
+		allvars.insert(allvars.end(), edges.begin(), edges.end());
+		allvars.insert(allvars.end(), allnodes.begin(), allnodes.end());
+
 		// Branching heuristics
 		DecisionBuilder* const db = solver.MakePhase(edges,
 			Solver::CHOOSE_MAX_REGRET_ON_MIN,//CHOOSE_RANDOM,
 			Solver::ASSIGN_MIN_VALUE);
 
-		DecisionBuilder* const db1 = solver.MakePhase(allnodes,
+		DecisionBuilder* db1 = solver.MakePhase(allnodes,
 			Solver::CHOOSE_MAX_REGRET_ON_MIN,//CHOOSE_MIN_SIZE,
 			Solver::ASSIGN_MIN_VALUE);
 
+		// The race is not part of the search time
+		int64 raceTime = 0;
+		if (FLAGS_race) {
+			const int64 raceStart = solver.wall_time();
+			db1 = raceHeuristics(&solver, { { "allnodes", allnodes }, { "edges", edges } },
+				FLAGS_race_fail_limit, FLAGS_race_time_limit);
+			raceTime = solver.wall_time() - raceStart;
+			std::cout << "Race time: " << raceTime << " milliseconds.\n";
+		}
+
+		// Checkpoints
+		SearchCheckpoint checkpoint;
+		checkpoint.model = "k4p2-v4";
+
+		if (FLAGS_resume) {
+			if (!readCheckpoint(FLAGS_checkpoint_file, &checkpoint) || checkpoint.model != "k4p2-v4") {
+				std::cout << "No checkpoint of k4p2-v4 in " << FLAGS_checkpoint_file << "\n";
+				return;
+			}
+			db1 = makeReplayPhase(&solver, allvars, checkpoint, db1);
+		}
+
+		std::vector<SearchMonitor*> monitors;
+		if (!FLAGS_checkpoint_file.empty()) {
+			monitors.push_back(makeCheckpointMonitor(&solver, allvars, checkpoint, nullptr,
+				FLAGS_checkpoint_file, FLAGS_checkpoint_interval));
+		}
+
+		// Only the summary is printed, so one sample per second is plenty
+		TelemetryMonitor* telemetry = nullptr;
+		if (FLAGS_telemetry) {
+			telemetry = makeTelemetryMonitor(&solver, 1000);
+			monitors.push_back(telemetry);
+		}
+
 		// Search!
 
-		solver.Solve(db1);
+		solver.NewSearch(db1, monitors);
 		//solver.Solve(db);
 
-		int numSolutions = 0;
+		int64 numSolutions = checkpoint.numSolutions;
 
 		// Print
 		while (solver.NextSolution()) {
@@ -122,12 +189,17 @@ namespace operations_research {
 			//printSolutionArray(allnodes);
 			//printSolutionArray(edges);
 		}
+		solver.EndSearch();
 
-		const int64 elapsedTime = solver.wall_time();
+		const int64 elapsedTime = solver.wall_time() - raceTime;
 
 		std::cout << "Total number of solutions: " << numSolutions << "\n";
 		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
 
+		if (telemetry != nullptr) {
+			telemetry->printSummary();
+		}
+
 
 	} // gracefulGraph
 
@@ -147,6 +219,11 @@ namespace operations_research {
 } // namespace operations_research
 
 int main(int argc, char** argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	if (FLAGS_resume && FLAGS_checkpoint_file.empty()) {
+		std::cout << "--resume needs --checkpoint_file\n";
+		return 1;
+	}
 	operations_research::gracefulGraph();
 	getchar();
 	return 0;
@@ -0,0 +1,70 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Queries a store written with --store_file.
+//
+// Usage: labeling-query <store file> [label ...]
+//
+// Prints the stored labelings that start with the given labels. With as many
+// labels as nodes, tells instead whether that labeling is stored, up to the
+// symmetries of the graph, whose edges the store holds.
+
+#include <cstdlib>
+#include <iostream>
+
+#include "labeling-store.h"
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " <store file> [label ...]\n";
+		return 1;
+	}
+
+	operations_research::LabelingStore store;
+	if (!store.open(argv[1])) {
+		std::cout << "Could not open " << argv[1] << "\n";
+		return 1;
+	}
+
+	std::vector<int> prefix;
+	for (int i = 2; i < argc; i++) {
+		prefix.push_back(std::atoi(argv[i]));
+	}
+
+	if (prefix.size() == static_cast<size_t>(store.numNodes())) {
+		const bool found = store.contains(prefix);
+		std::cout << (found ? "Stored" : "Not stored");
+		if (found) {
+			std::cout << " as [ ";
+			for (int label : store.canonical(prefix)) {
+				std::cout << label << " ";
+			}
+			std::cout << "]";
+		}
+		std::cout << "\n";
+		return 0;
+	}
+
+	const std::pair<uint64_t, uint64_t> range = store.prefixRange(prefix);
+	for (uint64_t index = range.first; index < range.second; index++) {
+		std::cout << "[ ";
+		for (int label : store.labeling(index)) {
+			std::cout << label << " ";
+		}
+		std::cout << "]\n";
+	}
+
+	std::cout << "Matching labelings: " << range.second - range.first << " of " << store.size() << "\n";
+	return 0;
+} // main
@@ -0,0 +1,426 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Compact storage of complete sets of graph labelings.
+//
+// Every labeling is replaced by its canonical form, the lexicographically
+// smallest labeling among its images under the automorphisms of the graph and
+// the complement l -> m - l (which keeps a graceful labeling graceful).
+// Canonical labelings are sorted, deduplicated and bit-packed at
+// ceil(log2(m + 1)) bits per node, most significant bit first, so comparing
+// two records byte by byte compares the labelings lexicographically.
+//
+// File layout (little-endian):
+//   char[4]  magic "GLAB"
+//   uint32   version
+//   uint32   number of nodes
+//   uint32   largest label m
+//   uint32   bits per label
+//   uint32   bytes per record
+//   uint64   number of records
+//   uint32   edges[m][2]: the graph, so that a reader can canonicalize
+//            the labelings it looks up
+//   uint64   directory[m + 2]: index of the first record whose first label
+//            is at least l, for l = 0..m+1
+//   records
+//
+// LabelingStore memory-maps the file (see mapped-file.h), so membership and prefix queries only
+// touch the pages they need.
+
+#ifndef LABELING_STORE_H
+#define LABELING_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../mapped-file.h"
+
+namespace operations_research {
+
+	const char kLabelingStoreMagic[4] = { 'G', 'L', 'A', 'B' };
+	const uint32_t kLabelingStoreVersion = 2;
+	const size_t kLabelingStoreHeaderSize = 32;
+	// Bounds on the header fields, so that sizes computed from them cannot overflow
+	const uint32_t kLabelingStoreMaxNodes = 1 << 16;
+	const uint32_t kLabelingStoreMaxLabel = 1 << 24;
+
+	inline int bitsPerLabel(int maxLabel) {
+		int bits = 1;
+		while ((1 << bits) <= maxLabel) {
+			bits++;
+		}
+		return bits;
+	}
+
+	// Packs a labeling into recordBytes bytes, most significant bit first.
+	inline void packLabeling(const std::vector<int>& labeling, int bits, int recordBytes, uint8_t* record) {
+		std::memset(record, 0, recordBytes);
+		int position = 0;
+		for (int label : labeling) {
+			for (int bit = bits - 1; bit >= 0; bit--, position++) {
+				if ((label >> bit) & 1) {
+					record[position / 8] |= 0x80 >> (position % 8);
+				}
+			}
+		}
+	}
+
+	inline int unpackLabel(const uint8_t* record, int bits, int node) {
+		int label = 0;
+		for (int position = node * bits; position < (node + 1) * bits; position++) {
+			label = (label << 1) | ((record[position / 8] >> (7 - position % 8)) & 1);
+		}
+		return label;
+	}
+
+	// Symmetry group of the labelings of a graph.
+	class LabelingSymmetries {
+	public:
+		LabelingSymmetries(int numNodes, const std::vector<std::pair<int, int>>& edges)
+			: numNodes_(numNodes), maxLabel_(edges.size()), edges_(edges),
+			adjacent_(static_cast<size_t>(numNodes) * numNodes, false) {
+			for (const auto& edge : edges) {
+				adjacent_[static_cast<size_t>(edge.first) * numNodes + edge.second] = true;
+				adjacent_[static_cast<size_t>(edge.second) * numNodes + edge.first] = true;
+			}
+			std::vector<int> image(numNodes, -1);
+			std::vector<bool> used(numNodes, false);
+			findAutomorphisms(0, &image, &used);
+		}
+
+		int numNodes() const { return numNodes_; }
+		int maxLabel() const { return maxLabel_; }
+		const std::vector<std::pair<int, int>>& edges() const { return edges_; }
+
+		// Automorphisms times the complement
+		int size() const { return 2 * automorphisms_.size(); }
+
+		std::vector<int> canonical(const std::vector<int>& labeling) const {
+			std::vector<int> best = labeling;
+			std::vector<int> image(numNodes_);
+			for (const std::vector<int>& automorphism : automorphisms_) {
+				for (int complement = 0; complement < 2; complement++) {
+					for (int node = 0; node < numNodes_; node++) {
+						const int label = labeling[node];
+						image[automorphism[node]] = complement ? maxLabel_ - label : label;
+					}
+					if (image < best) {
+						best = image;
+					}
+				}
+			}
+			return best;
+		}
+
+	private:
+		// Extends the partial automorphism mapping nodes 0..node-1
+		void findAutomorphisms(int node, std::vector<int>* image, std::vector<bool>* used) {
+			if (node == numNodes_) {
+				automorphisms_.push_back(*image);
+				return;
+			}
+			for (int target = 0; target < numNodes_; target++) {
+				if ((*used)[target]) {
+					continue;
+				}
+				bool consistent = true;
+				for (int previous = 0; previous < node && consistent; previous++) {
+					consistent = adjacent_[static_cast<size_t>(previous) * numNodes_ + node] ==
+						adjacent_[static_cast<size_t>((*image)[previous]) * numNodes_ + target];
+				}
+				if (consistent) {
+					(*image)[node] = target;
+					(*used)[target] = true;
+					findAutomorphisms(node + 1, image, used);
+					(*used)[target] = false;
+				}
+			}
+		}
+
+		const int numNodes_;
+		const int maxLabel_;
+		const std::vector<std::pair<int, int>> edges_;
+		std::vector<bool> adjacent_;
+		std::vector<std::vector<int>> automorphisms_;
+	};
+
+	// Collects labelings and writes their canonical forms to a store file.
+	class LabelingStoreWriter {
+	public:
+		explicit LabelingStoreWriter(const LabelingSymmetries& symmetries)
+			: symmetries_(symmetries), bits_(bitsPerLabel(symmetries.maxLabel())),
+			recordBytes_((symmetries.numNodes() * bits_ + 7) / 8), numAdded_(0) {}
+
+		void add(const std::vector<int>& labeling) {
+			const size_t offset = records_.size();
+			records_.resize(offset + recordBytes_);
+			packLabeling(symmetries_.canonical(labeling), bits_, recordBytes_, &records_[offset]);
+			numAdded_++;
+		}
+
+		int64_t numAdded() const { return numAdded_; }
+
+		// Sorts and deduplicates the records, writes the file and returns the
+		// number of distinct labelings written, or -1 on error.
+		int64_t write(const std::string& filename) {
+			const uint8_t* const data = records_.data();
+			const size_t recordBytes = recordBytes_;
+			std::vector<size_t> order(records_.size() / recordBytes);
+			for (size_t i = 0; i < order.size(); i++) {
+				order[i] = i * recordBytes;
+			}
+			auto less = [=](size_t a, size_t b) { return std::memcmp(data + a, data + b, recordBytes) < 0; };
+			auto equal = [=](size_t a, size_t b) { return std::memcmp(data + a, data + b, recordBytes) == 0; };
+			std::sort(order.begin(), order.end(), less);
+			order.erase(std::unique(order.begin(), order.end(), equal), order.end());
+
+			const int maxLabel = symmetries_.maxLabel();
+			std::vector<uint64_t> directory(maxLabel + 2);
+			size_t index = 0;
+			for (int label = 0; label <= maxLabel + 1; label++) {
+				while (index < order.size() && unpackLabel(data + order[index], bits_, 0) < label) {
+					index++;
+				}
+				directory[label] = index;
+			}
+
+			std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+			const uint32_t header[5] = { kLabelingStoreVersion, static_cast<uint32_t>(symmetries_.numNodes()),
+				static_cast<uint32_t>(maxLabel), static_cast<uint32_t>(bits_), static_cast<uint32_t>(recordBytes_) };
+			const uint64_t count = order.size();
+			out.write(kLabelingStoreMagic, sizeof(kLabelingStoreMagic));
+			out.write(reinterpret_cast<const char*>(header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+			for (const auto& edge : symmetries_.edges()) {
+				const uint32_t nodes[2] = { static_cast<uint32_t>(edge.first), static_cast<uint32_t>(edge.second) };
+				out.write(reinterpret_cast<const char*>(nodes), sizeof(nodes));
+			}
+			out.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(uint64_t));
+			for (size_t offset : order) {
+				out.write(reinterpret_cast<const char*>(data + offset), recordBytes);
+			}
+			return out ? static_cast<int64_t>(order.size()) : -1;
+		}
+
+	private:
+		const LabelingSymmetries& symmetries_;
+		const int bits_;
+		const int recordBytes_;
+		std::vector<uint8_t> records_;
+		int64_t numAdded_;
+	};
+
+	// Read-only, memory-mapped view of a store file.
+	class LabelingStore {
+	public:
+		LabelingStore() : directory_(nullptr), records_(nullptr) {}
+
+		LabelingStore(const LabelingStore&) = delete;
+		LabelingStore& operator=(const LabelingStore&) = delete;
+
+		// Fails unless the file is a store whose header matches its contents.
+		bool open(const std::string& filename) {
+			close();
+			if (!file_.open(filename) || file_.size() < kLabelingStoreHeaderSize ||
+				std::memcmp(file_.data(), kLabelingStoreMagic, sizeof(kLabelingStoreMagic)) != 0) {
+				close();
+				return false;
+			}
+
+			uint32_t header[5];
+			uint64_t count;
+			std::memcpy(header, file_.data() + 4, sizeof(header));
+			std::memcpy(&count, file_.data() + 24, sizeof(count));
+			if (header[0] != kLabelingStoreVersion || header[1] == 0 || header[1] > kLabelingStoreMaxNodes ||
+				header[2] > kLabelingStoreMaxLabel) {
+				close();
+				return false;
+			}
+			numNodes_ = header[1];
+			maxLabel_ = header[2];
+			bits_ = bitsPerLabel(maxLabel_);
+			recordBytes_ = (numNodes_ * bits_ + 7) / 8;
+			if (header[3] != static_cast<uint32_t>(bits_) || header[4] != static_cast<uint32_t>(recordBytes_)) {
+				close();
+				return false;
+			}
+
+			// Offsets, not pointers, are checked against the size of the file
+			const size_t edgesBytes = static_cast<size_t>(maxLabel_) * 2 * sizeof(uint32_t);
+			const size_t directoryOffset = kLabelingStoreHeaderSize + edgesBytes;
+			const size_t directoryBytes = (static_cast<size_t>(maxLabel_) + 2) * sizeof(uint64_t);
+			const size_t recordsOffset = directoryOffset + directoryBytes;
+			if (recordsOffset > file_.size() || count > (file_.size() - recordsOffset) / recordBytes_) {
+				close();
+				return false;
+			}
+			count_ = count;
+			directory_ = reinterpret_cast<const uint64_t*>(file_.data() + directoryOffset);
+			records_ = file_.data() + recordsOffset;
+
+			std::vector<std::pair<int, int>> edges(maxLabel_);
+			for (int edge = 0; edge < maxLabel_; edge++) {
+				uint32_t nodes[2];
+				std::memcpy(nodes, file_.data() + kLabelingStoreHeaderSize + edge * sizeof(nodes), sizeof(nodes));
+				if (nodes[0] >= header[1] || nodes[1] >= header[1] || nodes[0] == nodes[1]) {
+					close();
+					return false;
+				}
+				edges[edge] = { static_cast<int>(nodes[0]), static_cast<int>(nodes[1]) };
+			}
+
+			// firstLabelRange() trusts the directory to be sorted and within bounds
+			for (int label = 0; label <= maxLabel_ + 1; label++) {
+				if (directory_[label] > count_ || (label > 0 && directory_[label] < directory_[label - 1])) {
+					close();
+					return false;
+				}
+			}
+			symmetries_.reset(new LabelingSymmetries(numNodes_, edges));
+			return true;
+		}
+
+		void close() {
+			file_.close();
+			directory_ = nullptr;
+			records_ = nullptr;
+			count_ = 0;
+			symmetries_.reset();
+		}
+
+		uint64_t size() const { return count_; }
+		int numNodes() const { return numNodes_; }
+		int maxLabel() const { return maxLabel_; }
+
+		std::vector<int> labeling(uint64_t index) const {
+			std::vector<int> result(numNodes_);
+			for (int node = 0; node < numNodes_; node++) {
+				result[node] = unpackLabel(record(index), bits_, node);
+			}
+			return result;
+		}
+
+		// Graph of the stored labelings
+		const std::vector<std::pair<int, int>>& edges() const { return symmetries_->edges(); }
+
+		// The canonical form of a labeling (see LabelingSymmetries::canonical),
+		// which is what the store holds.
+		std::vector<int> canonical(const std::vector<int>& labeling) const {
+			return symmetries_->canonical(labeling);
+		}
+
+		// Whether the labeling, or one of its images under the symmetries of the
+		// graph, is stored.
+		bool contains(const std::vector<int>& labeling) const {
+			if (labeling.size() != static_cast<size_t>(numNodes_)) {
+				return false;
+			}
+			for (int label : labeling) {
+				if (label < 0 || label > maxLabel_) {
+					return false;
+				}
+			}
+			const std::vector<int> canonicalLabeling = canonical(labeling);
+			std::vector<uint8_t> packed(recordBytes_);
+			packLabeling(canonicalLabeling, bits_, recordBytes_, packed.data());
+			const std::pair<uint64_t, uint64_t> range = firstLabelRange(canonicalLabeling[0]);
+			uint64_t low = range.first;
+			uint64_t high = range.second;
+			while (low < high) {
+				const uint64_t middle = low + (high - low) / 2;
+				const int cmp = std::memcmp(record(middle), packed.data(), recordBytes_);
+				if (cmp == 0) {
+					return true;
+				}
+				if (cmp < 0) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			return false;
+		}
+
+		// Returns the range [first, last) of the records that start with prefix.
+		std::pair<uint64_t, uint64_t> prefixRange(const std::vector<int>& prefix) const {
+			if (prefix.empty()) {
+				return { 0, count_ };
+			}
+			if (prefix.size() > static_cast<size_t>(numNodes_)) {
+				return { 0, 0 };
+			}
+			const std::pair<uint64_t, uint64_t> range = firstLabelRange(prefix[0]);
+			const uint64_t first = partitionPoint(range.first, range.second,
+				[&](uint64_t index) { return comparePrefix(index, prefix) < 0; });
+			const uint64_t last = partitionPoint(first, range.second,
+				[&](uint64_t index) { return comparePrefix(index, prefix) <= 0; });
+			return { first, last };
+		}
+
+	private:
+		const uint8_t* record(uint64_t index) const { return records_ + index * recordBytes_; }
+
+		std::pair<uint64_t, uint64_t> firstLabelRange(int label) const {
+			if (label < 0 || label > maxLabel_) {
+				return { 0, 0 };
+			}
+			return { directory_[label], directory_[label + 1] };
+		}
+
+		int comparePrefix(uint64_t index, const std::vector<int>& prefix) const {
+			for (size_t node = 0; node < prefix.size(); node++) {
+				const int label = unpackLabel(record(index), bits_, node);
+				if (label != prefix[node]) {
+					return label < prefix[node] ? -1 : 1;
+				}
+			}
+			return 0;
+		}
+
+		// First index in [low, high) for which predicate is false
+		template <typename Predicate>
+		static uint64_t partitionPoint(uint64_t low, uint64_t high, Predicate predicate) {
+			while (low < high) {
+				const uint64_t middle = low + (high - low) / 2;
+				if (predicate(middle)) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			return low;
+		}
+
+		MappedFile file_;
+		std::unique_ptr<LabelingSymmetries> symmetries_;
+		const uint64_t* directory_;
+		const uint8_t* records_;
+		uint64_t count_ = 0;
+		int numNodes_ = 0;
+		int maxLabel_ = 0;
+		int bits_ = 0;
+		int recordBytes_ = 0;
+	};
+
+} // namespace operations_research
+
+#endif // LABELING_STORE_H
@@ -0,0 +1,106 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Read-only memory mapping of a whole file, with mmap on POSIX systems and
+// file mappings on Windows.
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace operations_research {
+
+	class MappedFile {
+	public:
+		MappedFile() : data_(nullptr), size_(0) {}
+		~MappedFile() { close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Fails on empty files, which cannot be mapped.
+		bool open(const std::string& filename) {
+			close();
+#ifdef _WIN32
+			const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+				const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (mapping != nullptr) {
+					data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+					size_ = data_ != nullptr ? static_cast<size_t>(fileSize.QuadPart) : 0;
+					CloseHandle(mapping);
+				}
+			}
+			CloseHandle(file);
+#else
+			const int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == 0 && info.st_size > 0) {
+				void* const data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+				if (data != MAP_FAILED) {
+					data_ = static_cast<const uint8_t*>(data);
+					size_ = info.st_size;
+				}
+			}
+			::close(fd);
+#endif
+			return data_ != nullptr;
+		}
+
+		void close() {
+			if (data_ != nullptr) {
+#ifdef _WIN32
+				UnmapViewOfFile(data_);
+#else
+				munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+			}
+			data_ = nullptr;
+			size_ = 0;
+		}
+
+		const uint8_t* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+		const uint8_t* data_;
+		size_t size_;
+	};
+
+} // namespace operations_research
+
+#endif // MAPPED_FILE_H
@@ -16,19 +16,352 @@
 
 #include "ortools/base/commandlineflags.h"
 #include "ortools/constraint_solver/constraint_solveri.h"
+#include "cpsat-backend.h"
+#include "search-checkpoint.h"
+#include "search-racing.h"
+#include "search-telemetry.h"
 
 DEFINE_int32(
 	size, 0,
 	"Size of the problem. If equal to 0, will test several sizes.");
+DEFINE_bool(
+	race, false,
+	"Race the branching heuristics on short probes and search with the winner.");
+DEFINE_int64(
+	race_fail_limit, 1000,
+	"Failure limit of the first round of probes when racing.");
+DEFINE_int64(
+	race_time_limit, 1000,
+	"Time limit in milliseconds of each probe when racing.");
+DEFINE_string(
+	backend, "cp",
+	"Solver used for the model: cp (original constraint solver) or cpsat.");
+DEFINE_int32(
+	workers, 8,
+	"Number of search workers of the cpsat backend.");
+DEFINE_bool(
+	all_solutions, true,
+	"Enumerate all the solutions. If false, stop at the first one.");
+DEFINE_string(
+	output_file, "",
+	"File the solutions are written to. If empty, they are written to the standard output.");
+DEFINE_string(
+	checkpoint_file, "",
+	"File the search is periodically checkpointed to. If empty, there are no checkpoints.");
+DEFINE_int64(
+	checkpoint_interval, 60000,
+	"Time in milliseconds between two checkpoints.");
+DEFINE_bool(
+	resume, false,
+	"Resume the search of --size from --checkpoint_file, appending to --output_file.");
+DEFINE_bool(
+	telemetry, false,
+	"Print search statistics at the end of the search.");
+DEFINE_string(
+	telemetry_file, "",
+	"File the search statistics are written to, as CSV if its name ends in .csv and as JSON otherwise.");
+DEFINE_int64(
+	telemetry_interval, 1000,
+	"Time in milliseconds between two samples of the search statistics.");
+DEFINE_string(
+	profile_file, "",
+	"File the propagation profile of each constraint is written to.");
+DEFINE_bool(
+	diagonal_bounds, true,
+	"Also enforce bounds consistency (Hall intervals) on the diagonals, as MakeAllDifferent does.");
 
 
 namespace operations_research {
 
-	void printSolutionArray(std::vector<IntVar*> arrayOfVars);
+	void printSolutionArray(std::vector<IntVar*> arrayOfVars, std::ostream& out = std::cout);
+	void printSatSolutionArray(const sat::CpSolverResponse& response, const std::vector<int>& vars,
+		std::ostream& out = std::cout);
+
+	// All vars[i] + offsets[i] must be different.
+	// Posting it directly on vars saves creating a variable, with its own demons
+	// and trail entries, for each sum. When vars[i] is bound, its value is
+	// removed from the others; optionally, bounds consistency is also enforced
+	// by looking for Hall intervals among the shifted bounds, in O(n log n)
+	// (Lopez-Ortiz, Quimper, Tromp and van Beek, "A fast and simple algorithm
+	// for bounds consistency of the alldifferent constraint", IJCAI 2003).
+	class AllDifferentWithOffsets : public Constraint {
+	public:
+		AllDifferentWithOffsets(Solver* const s, const std::vector<IntVar*>& vars,
+			const std::vector<int64>& offsets, bool boundsConsistency)
+			: Constraint(s), vars_(vars), offsets_(offsets), boundsConsistency_(boundsConsistency),
+			minValue_(shiftedMin(vars, offsets)),
+			processed_(vars.size()),
+			taken_(shiftedMax(vars, offsets) - minValue_ + 1),
+			min_(vars.size()), max_(vars.size()),
+			minSorted_(vars.size()), maxSorted_(vars.size()), minRank_(vars.size()), maxRank_(vars.size()),
+			bounds_(2 * vars.size() + 2), tree_(2 * vars.size() + 2), hall_(2 * vars.size() + 2),
+			capacity_(2 * vars.size() + 2), numBounds_(0) {
+			const int size = vars.size();
+			for (int i = 0; i < size; i++) {
+				minSorted_[i] = i;
+				maxSorted_[i] = i;
+			}
+		}
+
+		void Post() override {
+			const int size = vars_.size();
+			for (int i = 0; i < size; i++) {
+				Demon* const d = MakeConstraintDemon1(solver(), this,
+					&AllDifferentWithOffsets::Bound, "Bound", i);
+				vars_[i]->WhenBound(d);
+			}
+			if (boundsConsistency_) {
+				Demon* const d = MakeDelayedConstraintDemon0(solver(), this,
+					&AllDifferentWithOffsets::PropagateBounds, "PropagateBounds");
+				for (IntVar* const var : vars_) {
+					var->WhenRange(d);
+				}
+			}
+		}
+
+		void InitialPropagate() override {
+			const int size = vars_.size();
+			for (int i = 0; i < size; i++) {
+				if (vars_[i]->Bound()) {
+					Bound(i);
+				}
+			}
+			if (boundsConsistency_) {
+				PropagateBounds();
+			}
+		}
+
+		// vars_[index] + offsets_[index] is taken, no other variable can take it
+		void Bound(int index) {
+			// The demon can run again for a variable bound during InitialPropagate
+			if (processed_.IsSet(index)) {
+				return;
+			}
+			processed_.SetToOne(solver(), index);
+
+			const int64 value = vars_[index]->Min() + offsets_[index];
+			if (taken_.IsSet(value - minValue_)) {
+				solver()->Fail();
+			}
+			taken_.SetToOne(solver(), value - minValue_);
+
+			const int size = vars_.size();
+			for (int i = 0; i < size; i++) {
+				if (i != index) {
+					vars_[i]->RemoveValue(value - offsets_[i]);
+				}
+			}
+		}
+
+		// If k variables have their shifted domains inside an interval [a, b] of
+		// k values, those values are taken and the other variables must avoid them.
+		void PropagateBounds() {
+			const int size = vars_.size();
+			if (size == 0) {
+				return;
+			}
+			for (int i = 0; i < size; i++) {
+				min_[i] = vars_[i]->Min() + offsets_[i];
+				max_[i] = vars_[i]->Max() + offsets_[i];
+			}
+			sortBounds();
+			if (!filterLower() || !filterUpper()) {
+				solver()->Fail();
+			}
+			for (int i = 0; i < size; i++) {
+				vars_[i]->SetRange(min_[i] - offsets_[i], max_[i] - offsets_[i]);
+			}
+		}
+
+		std::string DebugString() const override { return "AllDifferentWithOffsets"; }
+
+	private:
+		// Ranks the shifted bounds: bounds_[1..numBounds_] are the distinct mins
+		// and maxs + 1 in increasing order, between two sentinels.
+		void sortBounds() {
+			const int size = min_.size();
+			std::sort(minSorted_.begin(), minSorted_.end(), [&](int x, int y) { return min_[x] < min_[y]; });
+			std::sort(maxSorted_.begin(), maxSorted_.end(), [&](int x, int y) { return max_[x] < max_[y]; });
+			int64 min = min_[minSorted_[0]];
+			int64 max = max_[maxSorted_[0]] + 1;
+			int64 last = min - 2;
+			int numBounds = 0;
+			bounds_[0] = last;
+			int i = 0;
+			int j = 0;
+			while (true) {
+				if (i < size && min <= max) {
+					if (min != last) {
+						bounds_[++numBounds] = last = min;
+					}
+					minRank_[minSorted_[i]] = numBounds;
+					if (++i < size) {
+						min = min_[minSorted_[i]];
+					}
+				}
+				else {
+					if (max != last) {
+						bounds_[++numBounds] = last = max;
+					}
+					maxRank_[maxSorted_[j]] = numBounds;
+					if (++j == size) {
+						break;
+					}
+					max = max_[maxSorted_[j]] + 1;
+				}
+			}
+			numBounds_ = numBounds;
+			bounds_[numBounds + 1] = bounds_[numBounds] + 2;
+		}
+
+		// Follows the links of t from i while they go up (pathMax) or down (pathMin)
+		static int pathMax(const std::vector<int>& t, int i) {
+			while (t[i] > i) {
+				i = t[i];
+			}
+			return i;
+		}
+
+		static int pathMin(const std::vector<int>& t, int i) {
+			while (t[i] < i) {
+				i = t[i];
+			}
+			return i;
+		}
+
+		// Points every link on the path from start to end at to
+		static void pathSet(std::vector<int>* t, int start, int end, int to) {
+			int next = start;
+			int current;
+			while ((current = next) != end) {
+				next = (*t)[current];
+				(*t)[current] = to;
+			}
+		}
+
+		// Raises the mins past the Hall intervals, sweeping by increasing max.
+		// Returns false if some interval holds more variables than values.
+		bool filterLower() {
+			const int size = min_.size();
+			for (int i = 1; i <= numBounds_ + 1; i++) {
+				tree_[i] = hall_[i] = i - 1;
+				capacity_[i] = bounds_[i] - bounds_[i - 1];
+			}
+			for (int i = 0; i < size; i++) {
+				const int var = maxSorted_[i];
+				const int x = minRank_[var];
+				const int y = maxRank_[var];
+				int z = pathMax(tree_, x + 1);
+				const int j = tree_[z];
+				if (--capacity_[z] == 0) {
+					tree_[z] = z + 1;
+					z = pathMax(tree_, tree_[z]);
+					tree_[z] = j;
+				}
+				pathSet(&tree_, x + 1, z, z);
+				if (capacity_[z] < bounds_[z] - bounds_[y]) {
+					return false;
+				}
+				if (hall_[x] > x) {
+					const int w = pathMax(hall_, hall_[x]);
+					min_[var] = bounds_[w];
+					pathSet(&hall_, x, w, w);
+				}
+				if (capacity_[z] == bounds_[z] - bounds_[y]) {
+					pathSet(&hall_, hall_[y], j - 1, y);
+					hall_[y] = j - 1;
+				}
+			}
+			return true;
+		}
+
+		// Same as filterLower, lowering the maxs by decreasing min
+		bool filterUpper() {
+			const int size = min_.size();
+			for (int i = 0; i <= numBounds_; i++) {
+				tree_[i] = hall_[i] = i + 1;
+				capacity_[i] = bounds_[i + 1] - bounds_[i];
+			}
+			for (int i = size - 1; i >= 0; i--) {
+				const int var = minSorted_[i];
+				const int x = maxRank_[var];
+				const int y = minRank_[var];
+				int z = pathMin(tree_, x - 1);
+				const int j = tree_[z];
+				if (--capacity_[z] == 0) {
+					tree_[z] = z - 1;
+					z = pathMin(tree_, tree_[z]);
+					tree_[z] = j;
+				}
+				pathSet(&tree_, x - 1, z, z);
+				if (capacity_[z] < bounds_[y] - bounds_[z]) {
+					return false;
+				}
+				if (hall_[x] < x) {
+					const int w = pathMin(hall_, hall_[x]);
+					max_[var] = bounds_[w] - 1;
+					pathSet(&hall_, x, w, w);
+				}
+				if (capacity_[z] == bounds_[y] - bounds_[z]) {
+					pathSet(&hall_, hall_[y], j + 1, y);
+					hall_[y] = j + 1;
+				}
+			}
+			return true;
+		}
+
+		static int64 shiftedMin(const std::vector<IntVar*>& vars, const std::vector<int64>& offsets) {
+			int64 result = kint64max;
+			const int size = vars.size();
+			for (int i = 0; i < size; i++) {
+				result = std::min(result, vars[i]->Min() + offsets[i]);
+			}
+			return result;
+		}
+
+		static int64 shiftedMax(const std::vector<IntVar*>& vars, const std::vector<int64>& offsets) {
+			int64 result = kint64min;
+			const int size = vars.size();
+			for (int i = 0; i < size; i++) {
+				result = std::max(result, vars[i]->Max() + offsets[i]);
+			}
+			return result;
+		}
+
+		const std::vector<IntVar*> vars_;
+		const std::vector<int64> offsets_;
+		const bool boundsConsistency_;
+		const int64 minValue_;
+		RevBitSet processed_;  // Variables whose value has been removed from the others
+		RevBitSet taken_;      // Shifted values of the bound variables
+
+		// Scratch space of PropagateBounds
+		std::vector<int64> min_;
+		std::vector<int64> max_;
+		std::vector<int> minSorted_;
+		std::vector<int> maxSorted_;
+		std::vector<int> minRank_;
+		std::vector<int> maxRank_;
+		std::vector<int64> bounds_;
+		std::vector<int> tree_;
+		std::vector<int> hall_;
+		std::vector<int64> capacity_;
+		int numBounds_;
+	};
+
+	Constraint* makeAllDifferentWithOffsets(Solver* const solver, const std::vector<IntVar*>& vars,
+		const std::vector<int64>& offsets, bool boundsConsistency) {
+		return solver->RevAlloc(new AllDifferentWithOffsets(solver, vars, offsets, boundsConsistency));
+	}
 
 	void nqueens(int64 numQueens) {
+		const bool telemetryEnabled = FLAGS_telemetry || !FLAGS_telemetry_file.empty();
+		TelemetryTimers timers;
+		TelemetryTimers* const sectionTimers = telemetryEnabled ? &timers : nullptr;
+		ScopedTimer modelTimer(sectionTimers, "model");
+
 		// Instantiate the solver.
-		Solver solver("nQueens");
+		Solver solver("nQueens", telemetryParameters(!FLAGS_profile_file.empty()));
 		//const int64 numQueens = 13;
 
 		// Decision variables
@@ -40,53 +373,183 @@ namespace operations_research {
 		// Each queen must be on a different row and column 
 		solver.AddConstraint(solver.MakeAllDifferent(board));
 
-		// Each queen must be on a different diagonal
-		std::vector<IntVar*> diag1(numQueens);
-		std::vector<IntVar*> diag2(numQueens);
+		// Each queen must be on a different diagonal: all board[i] + i, and all
+		// board[i] - i, must be different
+		std::vector<int64> diag1(numQueens);
+		std::vector<int64> diag2(numQueens);
 
 		for (int i = 0; i < numQueens; i++) {
-			diag1[i] = solver.MakeSum(board[i], i)->Var();
-			diag2[i] = solver.MakeSum(board[i], -i)->Var();
+			diag1[i] = i;
+			diag2[i] = -i;
 		}
 
-		solver.AddConstraint(solver.MakeAllDifferent(diag1));
-		solver.AddConstraint(solver.MakeAllDifferent(diag2));
+		solver.AddConstraint(makeAllDifferentWithOffsets(&solver, board, diag1, FLAGS_diagonal_bounds));
+		solver.AddConstraint(makeAllDifferentWithOffsets(&solver, board, diag2, FLAGS_diagonal_bounds));
 
+		modelTimer.stop();
 
 		// Branching heuristics
-		DecisionBuilder* const db = solver.MakePhase(board,
+		DecisionBuilder* db = solver.MakePhase(board,
 			Solver::CHOOSE_MIN_SIZE,
 			Solver::ASSIGN_CENTER_VALUE);
 
+		// The race is not part of the search time
+		int64 raceTime = 0;
+		if (FLAGS_race) {
+			ScopedTimer raceTimer(sectionTimers, "race");
+			const int64 raceStart = solver.wall_time();
+			db = raceHeuristics(&solver, { { "board", board } },
+				FLAGS_race_fail_limit, FLAGS_race_time_limit);
+			raceTime = solver.wall_time() - raceStart;
+			std::cout << "Race time: " << raceTime << " milliseconds.\n";
+		}
+
+		// Checkpoints
+		SearchCheckpoint checkpoint;
+		checkpoint.model = "nqueens-" + std::to_string(numQueens);
+
+		if (FLAGS_resume) {
+			SearchCheckpoint saved;
+			if (!readCheckpoint(FLAGS_checkpoint_file, &saved) || saved.model != checkpoint.model) {
+				std::cout << "No checkpoint of " << checkpoint.model << " in " << FLAGS_checkpoint_file << "\n";
+				return;
+			}
+			checkpoint = saved;
+			db = makeReplayPhase(&solver, board, checkpoint, db);
+		}
+
+		std::ofstream outputFile;
+		if (!FLAGS_output_file.empty() &&
+			!openSolutionSink(FLAGS_output_file, FLAGS_resume ? &checkpoint : nullptr, &outputFile)) {
+			std::cout << "Could not open " << FLAGS_output_file << "\n";
+			return;
+		}
+		std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+
+		std::vector<SearchMonitor*> monitors;
+		if (!FLAGS_checkpoint_file.empty()) {
+			monitors.push_back(makeCheckpointMonitor(&solver, board, checkpoint, &outputFile,
+				FLAGS_checkpoint_file, FLAGS_checkpoint_interval));
+		}
+
+		TelemetryMonitor* telemetry = nullptr;
+		if (telemetryEnabled) {
+			telemetry = makeTelemetryMonitor(&solver, FLAGS_telemetry_interval);
+			monitors.push_back(telemetry);
+		}
+
 		// Search!
-		solver.Solve(db);
+		ScopedTimer searchTimer(sectionTimers, "search");
+		solver.NewSearch(db, monitors);
 
-		int numSolutions = 0;
+		int64 numSolutions = checkpoint.numSolutions;
 
 		// Print
 		while (solver.NextSolution()) {
 			numSolutions++;
-			std::cout << "Solution " << numSolutions << " :";
-			printSolutionArray(board);
+			output << "Solution " << numSolutions << " :";
+			printSolutionArray(board, output);
+			if (!FLAGS_all_solutions) {
+				break;
+			}
+		}
+		solver.EndSearch();
+		searchTimer.stop();
+
+		const int64 elapsedTime = solver.wall_time() - raceTime;
+
+		std::cout << "Total number of solutions: " << numSolutions << "\n";
+		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
+
+		if (telemetry != nullptr) {
+			telemetry->printSummary();
+			if (!FLAGS_telemetry_file.empty() && !telemetry->write(FLAGS_telemetry_file, &timers)) {
+				std::cout << "Could not write " << FLAGS_telemetry_file << "\n";
+			}
+		}
+		if (!FLAGS_profile_file.empty()) {
+			solver.ExportProfilingOverview(FLAGS_profile_file);
+		}
+
+	}
+
+	// Same model as nqueens(), written for the CP-SAT solver
+	void nqueensSat(int64 numQueens) {
+		sat::CpModelProto cpModel;
+
+		// Decision variables, plus one variable per queen and diagonal
+		std::vector<int> board(numQueens);
+		std::vector<int> diag1(numQueens);
+		std::vector<int> diag2(numQueens);
+
+		for (int i = 0; i < numQueens; i++) {
+			board[i] = addSatVar(&cpModel, 0, numQueens - 1);
+			diag1[i] = addSatVar(&cpModel, i, numQueens - 1 + i);
+			diag2[i] = addSatVar(&cpModel, -i, numQueens - 1 - i);
+			addSatOffset(&cpModel, diag1[i], board[i], i);
+			addSatOffset(&cpModel, diag2[i], board[i], -i);
+		}
+
+		// Constraints
+		addSatAllDifferent(&cpModel, board);
+		addSatAllDifferent(&cpModel, diag1);
+		addSatAllDifferent(&cpModel, diag2);
+
+		std::ofstream outputFile;
+		if (!FLAGS_output_file.empty() && !openSolutionSink(FLAGS_output_file, nullptr, &outputFile)) {
+			std::cout << "Could not open " << FLAGS_output_file << "\n";
+			return;
 		}
+		std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
 
-		const int64 elapsedTime = solver.wall_time();
+		// Search!
+		int numSolutions = 0;
+		const sat::CpSolverResponse response = solveSat(cpModel, FLAGS_workers, FLAGS_all_solutions,
+			[&](const sat::CpSolverResponse& solution) {
+			numSolutions++;
+			output << "Solution " << numSolutions << " :";
+			printSatSolutionArray(solution, board, output);
+		});
+
+		const int64 elapsedTime = static_cast<int64>(response.wall_time() * 1000);
 
 		std::cout << "Total number of solutions: " << numSolutions << "\n";
 		std::cout << "Total elapsed time: " << elapsedTime << " milliseconds.\n";
 
+		if (FLAGS_telemetry) {
+			printSatSummary(response);
+		}
+	}
+
+	void solve(int64 numQueens) {
+		if (FLAGS_backend == "cpsat") {
+			nqueensSat(numQueens);
+		}
+		else {
+			nqueens(numQueens);
+		}
 	}
 
 	// Prints the values of an array of variables between squre brakets 
-	void printSolutionArray(std::vector<IntVar*> arrayOfVars) {
+	void printSolutionArray(std::vector<IntVar*> arrayOfVars, std::ostream& out) {
 		int i = 0;
 		int size = arrayOfVars.size();
-		std::cout << "[";
+		out << "[";
 		while (i < size) {
-			std::cout << arrayOfVars[i]->Value();
+			out << arrayOfVars[i]->Value();
 			i++;
 		}
-		std::cout << "]\n";
+		out << "]\n";
+	}
+
+	// Same as printSolutionArray, for a solution of the CP-SAT solver
+	void printSatSolutionArray(const sat::CpSolverResponse& response, const std::vector<int>& vars,
+		std::ostream& out) {
+		out << "[";
+		for (int var : vars) {
+			out << response.solution(var);
+		}
+		out << "]\n";
 	}
 }
 
@@ -94,14 +557,27 @@ namespace operations_research {
 
 int main(int argc, char** argv) {
 	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	if (FLAGS_backend != "cp" && FLAGS_backend != "cpsat") {
+		std::cout << "Unknown backend: " << FLAGS_backend << "\n";
+		return 1;
+	}
+	if (FLAGS_backend == "cpsat" && (!FLAGS_checkpoint_file.empty() || FLAGS_resume ||
+		!FLAGS_telemetry_file.empty() || !FLAGS_profile_file.empty() || FLAGS_race)) {
+		std::cout << "The cpsat backend has no checkpoints, telemetry or profile files, nor racing\n";
+		return 1;
+	}
+	if (FLAGS_resume && (FLAGS_size == 0 || FLAGS_checkpoint_file.empty())) {
+		std::cout << "--resume needs --size and --checkpoint_file\n";
+		return 1;
+	}
 	if (FLAGS_size != 0) {
 		std::cout << "Solving for a board of size: " << FLAGS_size << "\n";
-		operations_research::nqueens(FLAGS_size);
+		operations_research::solve(FLAGS_size);
 	}
 	else {
 		for (int size = 4; size < 10; size++) {
 			std::cout << "Solving for a board of size: " << size << "\n";
-			operations_research::nqueens(size);
+			operations_research::solve(size);
 		}
 	}
 	return 0;
@@ -0,0 +1,299 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Checkpoint and resume of solution enumerations.
+//
+// A CheckpointMonitor keeps track of the decisions on the current branch of
+// the search tree (var == value on the left branch, var != value on the
+// right one) and periodically writes them to a file, together with the number
+// of solutions found so far and the size of the output they were written to.
+//
+// To resume, makeReplayPhase() replays that branch before handing over to the
+// usual phase. Every var == value decision of the branch keeps its right
+// branch, so backtracking out of the replayed branch visits exactly the part
+// of the tree the interrupted search had not visited yet, whatever the
+// branching heuristic does below it.
+
+#ifndef SEARCH_CHECKPOINT_H
+#define SEARCH_CHECKPOINT_H
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ortools/constraint_solver/constraint_solveri.h"
+
+namespace operations_research {
+
+	// One decision of a branch: vars[var] == value, or vars[var] != value if
+	// the left branch was already explored.
+	struct CheckpointDecision {
+		int var;
+		int64 value;
+		bool refuted;
+	};
+
+	struct SearchCheckpoint {
+		std::string model;
+		int64 numSolutions = 0;
+		int64 sinkPosition = -1;  // -1 if the solutions were not written to a file
+		std::vector<CheckpointDecision> path;
+	};
+
+	// Writes the checkpoint to a temporary file first, so an interruption while
+	// writing never leaves a truncated checkpoint behind.
+	inline bool writeCheckpoint(const std::string& filename, const SearchCheckpoint& checkpoint) {
+		const std::string tmpFilename = filename + ".tmp";
+		{
+			std::ofstream out(tmpFilename, std::ios::trunc);
+			out << "model " << checkpoint.model << "\n";
+			out << "solutions " << checkpoint.numSolutions << "\n";
+			out << "sink " << checkpoint.sinkPosition << "\n";
+			out << "path " << checkpoint.path.size() << "\n";
+			for (const CheckpointDecision& decision : checkpoint.path) {
+				out << decision.var << " " << decision.value << " " << decision.refuted << "\n";
+			}
+			if (!out) {
+				return false;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(tmpFilename, filename, error);
+		return !error;
+	}
+
+	inline bool readCheckpoint(const std::string& filename, SearchCheckpoint* checkpoint) {
+		std::ifstream in(filename);
+		std::string key;
+		size_t pathSize = 0;
+		in >> key >> checkpoint->model;
+		in >> key >> checkpoint->numSolutions;
+		in >> key >> checkpoint->sinkPosition;
+		in >> key >> pathSize;
+		checkpoint->path.resize(pathSize);
+		for (CheckpointDecision& decision : checkpoint->path) {
+			in >> decision.var >> decision.value >> decision.refuted;
+		}
+		return static_cast<bool>(in);
+	}
+
+	// Opens the file solutions are written to. When resuming, everything written
+	// after the checkpoint is dropped, as those solutions will be found again.
+	inline bool openSolutionSink(const std::string& filename, const SearchCheckpoint* resumeFrom,
+		std::ofstream* sink) {
+		if (resumeFrom != nullptr && resumeFrom->sinkPosition >= 0) {
+			std::error_code error;
+			std::filesystem::resize_file(filename, resumeFrom->sinkPosition, error);
+			if (error) {
+				return false;
+			}
+			sink->open(filename, std::ios::app);
+		}
+		else {
+			sink->open(filename, std::ios::trunc);
+		}
+		return sink->is_open();
+	}
+
+	// Replays one decision of a checkpointed branch.
+	class ReplayDecision : public Decision {
+	public:
+		ReplayDecision(IntVar* const var, int64 value, bool refuted, bool* const replaying)
+			: var_(var), value_(value), refuted_(refuted), replaying_(replaying) {}
+
+		void Apply(Solver* const s) override {
+			if (refuted_) {
+				var_->RemoveValue(value_);
+			}
+			else {
+				var_->SetValue(value_);
+			}
+		}
+
+		// A refuted decision has no right branch left: its left branch was
+		// explored before the checkpoint. Otherwise the right branch belongs to
+		// the usual phase.
+		void Refute(Solver* const s) override {
+			if (refuted_) {
+				s->Fail();
+			}
+			s->SaveAndSetValue(replaying_, false);
+			var_->RemoveValue(value_);
+		}
+
+		// DecisionVisitor has no visit for removing a value, the checkpoint
+		// monitor reads the decision with the accessors below instead.
+		void Accept(DecisionVisitor* const visitor) const override {
+			visitor->VisitUnknownDecision();
+		}
+
+		IntVar* var() const { return var_; }
+		int64 value() const { return value_; }
+		bool refuted() const { return refuted_; }
+
+		std::string DebugString() const override { return "ReplayDecision"; }
+
+	private:
+		IntVar* const var_;
+		const int64 value_;
+		const bool refuted_;
+		bool* const replaying_;
+	};
+
+	// Extracts var and value from the decisions of MakePhase().
+	class CheckpointDecisionVisitor : public DecisionVisitor {
+	public:
+		void VisitSetVariableValue(IntVar* const var, int64 value) override {
+			var_ = var;
+			value_ = value;
+		}
+
+		IntVar* var_ = nullptr;
+		int64 value_ = 0;
+	};
+
+	class CheckpointMonitor : public SearchMonitor {
+	public:
+		CheckpointMonitor(Solver* const solver, const std::vector<IntVar*>& vars,
+			const SearchCheckpoint& start, std::ofstream* sink,
+			const std::string& filename, int64 intervalMs)
+			: SearchMonitor(solver), filename_(filename), intervalMs_(intervalMs),
+			sink_(sink), checkpoint_(start), pathSize_(0), lastWrite_(0), decisions_(0) {
+			const int size = vars.size();
+			for (int i = 0; i < size; i++) {
+				index_[vars[i]] = i;
+			}
+			checkpoint_.path.clear();
+		}
+
+		void EnterSearch() override {
+			lastWrite_ = solver()->wall_time();
+		}
+
+		void ApplyDecision(Decision* const d) override {
+			push(d, false);
+
+			// Reading the clock on every decision would slow the search down
+			if (++decisions_ % 1024 == 0 && solver()->wall_time() - lastWrite_ >= intervalMs_) {
+				write();
+			}
+		}
+
+		void RefuteDecision(Decision* const d) override {
+			push(d, true);
+		}
+
+		bool AtSolution() override {
+			checkpoint_.numSolutions++;
+			return false;
+		}
+
+		// The enumeration is complete, there is nothing left to resume
+		void NoMoreSolutions() override {
+			std::remove(filename_.c_str());
+		}
+
+		std::string DebugString() const override { return "CheckpointMonitor"; }
+
+	private:
+		void push(Decision* const d, bool refuted) {
+			IntVar* var = nullptr;
+			int64 value = 0;
+			const ReplayDecision* const replay = dynamic_cast<const ReplayDecision*>(d);
+			if (replay != nullptr) {
+				var = replay->var();
+				value = replay->value();
+				refuted = refuted || replay->refuted();
+			}
+			else {
+				CheckpointDecisionVisitor visitor;
+				d->Accept(&visitor);
+				var = visitor.var_;
+				value = visitor.value_;
+			}
+			const auto it = index_.find(var);
+			CHECK(it != index_.end()) << "Can only checkpoint decisions on the given variables";
+
+			checkpoint_.path.resize(pathSize_);
+			checkpoint_.path.push_back({ it->second, value, refuted });
+			solver()->SaveAndSetValue(&pathSize_, pathSize_ + 1);
+		}
+
+		void write() {
+			checkpoint_.path.resize(pathSize_);
+			checkpoint_.sinkPosition = -1;
+			if (sink_ != nullptr && sink_->is_open()) {
+				sink_->flush();
+				checkpoint_.sinkPosition = sink_->tellp();
+			}
+			if (!writeCheckpoint(filename_, checkpoint_)) {
+				std::cout << "Could not write checkpoint to " << filename_ << "\n";
+			}
+			lastWrite_ = solver()->wall_time();
+		}
+
+		const std::string filename_;
+		const int64 intervalMs_;
+		std::ofstream* const sink_;
+		SearchCheckpoint checkpoint_;
+		std::unordered_map<const IntVar*, int> index_;
+		int pathSize_;  // Reversible: number of decisions on the current branch
+		int64 lastWrite_;
+		int64 decisions_;
+	};
+
+	class ReplayDecisionBuilder : public DecisionBuilder {
+	public:
+		ReplayDecisionBuilder(const std::vector<IntVar*>& vars,
+			const std::vector<CheckpointDecision>& path, DecisionBuilder* const phase)
+			: vars_(vars), path_(path), pathSize_(path.size()), phase_(phase), position_(0), replaying_(true) {}
+
+		Decision* Next(Solver* const s) override {
+			if (replaying_ && position_ < pathSize_) {
+				const CheckpointDecision& decision = path_[position_];
+				s->SaveAndSetValue(&position_, position_ + 1);
+				return s->RevAlloc(new ReplayDecision(vars_[decision.var], decision.value,
+					decision.refuted, &replaying_));
+			}
+			return phase_->Next(s);
+		}
+
+		std::string DebugString() const override { return "ReplayDecisionBuilder"; }
+
+	private:
+		const std::vector<IntVar*> vars_;
+		const std::vector<CheckpointDecision> path_;
+		const int pathSize_;
+		DecisionBuilder* const phase_;
+		int position_;
+		bool replaying_;
+	};
+
+	inline DecisionBuilder* makeReplayPhase(Solver* const solver, const std::vector<IntVar*>& vars,
+		const SearchCheckpoint& checkpoint, DecisionBuilder* const phase) {
+		return solver->RevAlloc(new ReplayDecisionBuilder(vars, checkpoint.path, phase));
+	}
+
+	inline SearchMonitor* makeCheckpointMonitor(Solver* const solver, const std::vector<IntVar*>& vars,
+		const SearchCheckpoint& start, std::ofstream* sink, const std::string& filename, int64 intervalMs) {
+		return solver->RevAlloc(new CheckpointMonitor(solver, vars, start, sink, filename, intervalMs));
+	}
+
+} // namespace operations_research
+
+#endif // SEARCH_CHECKPOINT_H
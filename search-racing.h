@@ -0,0 +1,147 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Heuristic racing.
+//
+// Instead of picking the branching heuristic of a model by hand, a race runs
+// short probes of every (variable set, variable strategy, value strategy)
+// combination on the model, keeps the better half of them and probes the
+// survivors again with twice the failure limit, until one is left.
+// The solver is single-threaded, so the probes are interleaved on the same
+// model rather than run in parallel.
+
+#ifndef SEARCH_RACING_H
+#define SEARCH_RACING_H
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ortools/constraint_solver/constraint_solveri.h"
+
+namespace operations_research {
+
+	// A set of variables a phase can branch on (e.g. the nodes or the edges).
+	struct RaceVarSet {
+		std::string name;
+		std::vector<IntVar*> vars;
+	};
+
+	// One (variable set, variable strategy, value strategy) combination and
+	// the outcome of its last probe.
+	struct RaceCandidate {
+		std::string name;
+		const std::vector<IntVar*>* vars;
+		Solver::IntVarStrategy varStrategy;
+		Solver::IntValueStrategy valueStrategy;
+		int64 solutions;
+		int64 failures;
+		bool completed;
+	};
+
+	// Strategies taking part in a race. The random strategies are left out so
+	// that the same model always has the same winner.
+	const std::vector<std::pair<std::string, Solver::IntVarStrategy>> kRaceVarStrategies = {
+		{ "CHOOSE_FIRST_UNBOUND", Solver::CHOOSE_FIRST_UNBOUND },
+		{ "CHOOSE_MIN_SIZE", Solver::CHOOSE_MIN_SIZE },
+		{ "CHOOSE_MAX_SIZE", Solver::CHOOSE_MAX_SIZE },
+		{ "CHOOSE_MAX_REGRET_ON_MIN", Solver::CHOOSE_MAX_REGRET_ON_MIN } };
+
+	const std::vector<std::pair<std::string, Solver::IntValueStrategy>> kRaceValueStrategies = {
+		{ "ASSIGN_MIN_VALUE", Solver::ASSIGN_MIN_VALUE },
+		{ "ASSIGN_MAX_VALUE", Solver::ASSIGN_MAX_VALUE },
+		{ "ASSIGN_CENTER_VALUE", Solver::ASSIGN_CENTER_VALUE } };
+
+	// Searches with the candidate until the search ends or a limit is crossed,
+	// and records how many solutions and failures it took.
+	inline void probeCandidate(Solver* solver, RaceCandidate* candidate,
+		int64 failLimit, int64 timeLimit) {
+		DecisionBuilder* const db = solver->MakePhase(*candidate->vars,
+			candidate->varStrategy,
+			candidate->valueStrategy);
+		SearchLimit* const limit = solver->MakeLimit(timeLimit, kint64max, failLimit, kint64max);
+
+		// failures() counts from the creation of the solver
+		const int64 failuresBefore = solver->failures();
+		int64 solutions = 0;
+
+		solver->NewSearch(db, limit);
+		while (solver->NextSolution()) {
+			solutions++;
+		}
+		candidate->completed = !limit->crossed();
+		solver->EndSearch();
+
+		candidate->solutions = solutions;
+		candidate->failures = solver->failures() - failuresBefore;
+	}
+
+	// A candidate that finished the whole search beats one that did not; between
+	// two finished ones, fewer failures wins; between two unfinished ones, more
+	// solutions per failure wins.
+	inline bool betterCandidate(const RaceCandidate& a, const RaceCandidate& b) {
+		if (a.completed != b.completed) {
+			return a.completed;
+		}
+		if (a.completed) {
+			return a.failures < b.failures;
+		}
+		return a.solutions * (b.failures + 1) > b.solutions * (a.failures + 1);
+	}
+
+	// Races every combination of the given variable sets and the strategies
+	// above, and returns a phase for the winner.
+	inline DecisionBuilder* raceHeuristics(Solver* solver,
+		const std::vector<RaceVarSet>& varSets, int64 failLimit, int64 timeLimit) {
+		std::vector<RaceCandidate> candidates;
+		for (const RaceVarSet& varSet : varSets) {
+			for (const auto& varStrategy : kRaceVarStrategies) {
+				for (const auto& valueStrategy : kRaceValueStrategies) {
+					candidates.push_back({ varSet.name + "/" + varStrategy.first + "/" + valueStrategy.first,
+						&varSet.vars, varStrategy.second, valueStrategy.second, 0, 0, false });
+				}
+			}
+		}
+
+		int round = 1;
+		while (candidates.size() > 1) {
+			std::cout << "Race round " << round << ": " << candidates.size()
+				<< " candidates, failure limit " << failLimit << "\n";
+
+			for (RaceCandidate& candidate : candidates) {
+				probeCandidate(solver, &candidate, failLimit, timeLimit);
+			}
+			std::stable_sort(candidates.begin(), candidates.end(), betterCandidate);
+
+			// Nothing can beat a candidate that already finished with the fewest failures
+			if (candidates[0].completed) {
+				break;
+			}
+			candidates.resize((candidates.size() + 1) / 2);
+			failLimit *= 2;
+			round++;
+		}
+
+		const RaceCandidate& winner = candidates[0];
+		std::cout << "Race winner: " << winner.name << " (" << winner.solutions << " solutions, "
+			<< winner.failures << " failures in its last probe)\n";
+
+		return solver->MakePhase(*winner.vars, winner.varStrategy, winner.valueStrategy);
+	}
+
+} // namespace operations_research
+
+#endif // SEARCH_RACING_H
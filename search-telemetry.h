@@ -0,0 +1,265 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Search telemetry.
+//
+// TelemetryMonitor samples the branches, failures, solutions, demon runs of
+// each priority and memory usage of a search at a fixed interval. At the end
+// it prints a summary and can write the samples, the summary and the section
+// timers as JSON, or the samples alone as CSV (if the file name ends in .csv).
+//
+// Demon runs per constraint are profiled by the solver itself when it is
+// created with profile_propagation set; see telemetryParameters().
+//
+// ScopedTimer adds the wall time of a section of the program (e.g. model
+// construction or search) to a TelemetryTimers. With a null TelemetryTimers
+// it does not read the clock at all.
+
+#ifndef SEARCH_TELEMETRY_H
+#define SEARCH_TELEMETRY_H
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ortools/constraint_solver/constraint_solveri.h"
+
+namespace operations_research {
+
+	// Milliseconds spent in each named section, in order of first use.
+	class TelemetryTimers {
+	public:
+		void add(const std::string& name, double ms) {
+			for (auto& timer : timers_) {
+				if (timer.first == name) {
+					timer.second += ms;
+					return;
+				}
+			}
+			timers_.push_back({ name, ms });
+		}
+
+		const std::vector<std::pair<std::string, double>>& timers() const { return timers_; }
+
+	private:
+		std::vector<std::pair<std::string, double>> timers_;
+	};
+
+	class ScopedTimer {
+	public:
+		ScopedTimer(TelemetryTimers* const timers, const std::string& name)
+			: timers_(timers), name_(name) {
+			if (timers_ != nullptr) {
+				start_ = std::chrono::steady_clock::now();
+			}
+		}
+
+		~ScopedTimer() { stop(); }
+
+		// Ends the section before the end of the scope.
+		void stop() {
+			if (timers_ != nullptr) {
+				const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_;
+				timers_->add(name_, elapsed.count());
+			}
+			timers_ = nullptr;
+		}
+
+	private:
+		TelemetryTimers* timers_;
+		const std::string name_;
+		std::chrono::steady_clock::time_point start_;
+	};
+
+	struct TelemetrySample {
+		int64 timeMs;
+		int64 branches;
+		int64 failures;
+		int64 solutions;
+		int64 varDemonRuns;
+		int64 normalDemonRuns;
+		int64 delayedDemonRuns;
+		int64 memoryBytes;
+	};
+
+	// Solver parameters for a solver that also profiles its propagation.
+	inline ConstraintSolverParameters telemetryParameters(bool profilePropagation) {
+		ConstraintSolverParameters parameters = Solver::DefaultSolverParameters();
+		parameters.set_profile_propagation(profilePropagation);
+		return parameters;
+	}
+
+	class TelemetryMonitor : public SearchMonitor {
+	public:
+		TelemetryMonitor(Solver* const solver, int64 intervalMs)
+			: SearchMonitor(solver), intervalMs_(intervalMs), nextSample_(0), peakMemory_(0), decisions_(0) {}
+
+		// The solver counts since its creation, samples count since the search began
+		void EnterSearch() override {
+			samples_.clear();
+			start_ = sampleNow();
+			start_.memoryBytes = 0;
+			nextSample_ = start_.timeMs;
+			sample();
+		}
+
+		// Called once per node of the search tree: reading the clock every time
+		// would slow the search down, so only every 1024th decision does
+		void BeginNextDecision(DecisionBuilder* const b) override {
+			if (++decisions_ % 1024 == 0 && solver()->wall_time() >= nextSample_) {
+				sample();
+			}
+		}
+
+		// Called by the solver once every 10000 demon runs, which also covers
+		// long propagations between two decisions
+		void PeriodicCheck() override {
+			if (solver()->wall_time() >= nextSample_) {
+				sample();
+			}
+		}
+
+		void ExitSearch() override {
+			sample();
+		}
+
+		std::string DebugString() const override { return "TelemetryMonitor"; }
+
+		const std::vector<TelemetrySample>& samples() const { return samples_; }
+
+		void printSummary() const {
+			if (samples_.empty()) {
+				return;
+			}
+			const TelemetrySample& last = samples_.back();
+			std::cout << "Total number of branches: " << last.branches << "\n";
+			std::cout << "Total number of failures: " << last.failures << "\n";
+			std::cout << "Total number of demon runs: "
+				<< last.varDemonRuns + last.normalDemonRuns + last.delayedDemonRuns << "\n";
+			std::cout << "Peak memory usage: " << peakMemory_ << " bytes.\n";
+		}
+
+		bool write(const std::string& filename, const TelemetryTimers* timers) const {
+			if (samples_.empty()) {
+				return false;
+			}
+			std::ofstream out(filename, std::ios::trunc);
+			if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0) {
+				writeCsv(out);
+			}
+			else {
+				writeJson(out, timers);
+			}
+			return static_cast<bool>(out);
+		}
+
+	private:
+		TelemetrySample sampleNow() const {
+			Solver* const s = solver();
+			return { s->wall_time(), s->branches(), s->failures(), s->solutions(),
+				s->demon_runs(Solver::VAR_PRIORITY),
+				s->demon_runs(Solver::NORMAL_PRIORITY),
+				s->demon_runs(Solver::DELAYED_PRIORITY),
+				Solver::MemoryUsage() };
+		}
+
+		void sample() {
+			const TelemetrySample now = sampleNow();
+			samples_.push_back({ now.timeMs - start_.timeMs,
+				now.branches - start_.branches,
+				now.failures - start_.failures,
+				now.solutions - start_.solutions,
+				now.varDemonRuns - start_.varDemonRuns,
+				now.normalDemonRuns - start_.normalDemonRuns,
+				now.delayedDemonRuns - start_.delayedDemonRuns,
+				now.memoryBytes });
+			peakMemory_ = std::max(peakMemory_, now.memoryBytes);
+			nextSample_ = now.timeMs + intervalMs_;
+		}
+
+		// Rate per second of a counter between two samples
+		static double rate(int64 from, int64 to, int64 fromMs, int64 toMs) {
+			return toMs > fromMs ? (to - from) * 1000.0 / (toMs - fromMs) : 0.0;
+		}
+
+		void writeCsv(std::ostream& out) const {
+			out << "time_ms,branches,failures,solutions,var_demon_runs,normal_demon_runs,"
+				"delayed_demon_runs,memory_bytes,branches_per_second,failures_per_second\n";
+			const int numSamples = samples_.size();
+			for (int i = 0; i < numSamples; i++) {
+				const TelemetrySample& s = samples_[i];
+				const TelemetrySample& previous = samples_[i > 0 ? i - 1 : 0];
+				out << s.timeMs << "," << s.branches << "," << s.failures << "," << s.solutions << ","
+					<< s.varDemonRuns << "," << s.normalDemonRuns << "," << s.delayedDemonRuns << ","
+					<< s.memoryBytes << ","
+					<< rate(previous.branches, s.branches, previous.timeMs, s.timeMs) << ","
+					<< rate(previous.failures, s.failures, previous.timeMs, s.timeMs) << "\n";
+			}
+		}
+
+		void writeJson(std::ostream& out, const TelemetryTimers* timers) const {
+			const TelemetrySample& last = samples_.back();
+			out << "{\n  \"samples\": [\n";
+			const int numSamples = samples_.size();
+			for (int i = 0; i < numSamples; i++) {
+				const TelemetrySample& s = samples_[i];
+				const TelemetrySample& previous = samples_[i > 0 ? i - 1 : 0];
+				out << "    {\"time_ms\": " << s.timeMs
+					<< ", \"branches\": " << s.branches
+					<< ", \"failures\": " << s.failures
+					<< ", \"solutions\": " << s.solutions
+					<< ", \"var_demon_runs\": " << s.varDemonRuns
+					<< ", \"normal_demon_runs\": " << s.normalDemonRuns
+					<< ", \"delayed_demon_runs\": " << s.delayedDemonRuns
+					<< ", \"memory_bytes\": " << s.memoryBytes
+					<< ", \"branches_per_second\": " << rate(previous.branches, s.branches, previous.timeMs, s.timeMs)
+					<< ", \"failures_per_second\": " << rate(previous.failures, s.failures, previous.timeMs, s.timeMs)
+					<< "}" << (i + 1 < numSamples ? "," : "") << "\n";
+			}
+			out << "  ],\n  \"summary\": {\"time_ms\": " << last.timeMs
+				<< ", \"branches\": " << last.branches
+				<< ", \"failures\": " << last.failures
+				<< ", \"solutions\": " << last.solutions
+				<< ", \"demon_runs\": " << last.varDemonRuns + last.normalDemonRuns + last.delayedDemonRuns
+				<< ", \"peak_memory_bytes\": " << peakMemory_ << "},\n";
+			out << "  \"timers_ms\": {";
+			if (timers != nullptr) {
+				const int numTimers = timers->timers().size();
+				for (int i = 0; i < numTimers; i++) {
+					out << (i > 0 ? ", " : "") << "\"" << timers->timers()[i].first << "\": "
+						<< timers->timers()[i].second;
+				}
+			}
+			out << "}\n}\n";
+		}
+
+		const int64 intervalMs_;
+		int64 nextSample_;
+		int64 peakMemory_;
+		int64 decisions_;
+		TelemetrySample start_;
+		std::vector<TelemetrySample> samples_;
+	};
+
+	inline TelemetryMonitor* makeTelemetryMonitor(Solver* const solver, int64 intervalMs) {
+		return solver->RevAlloc(new TelemetryMonitor(solver, intervalMs));
+	}
+
+} // namespace operations_research
+
+#endif // SEARCH_TELEMETRY_H
@@ -24,12 +24,68 @@
 // solutions being generated using some heuristic (e.g. cheapest addition).
 
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <memory>
+#include <random>
+#include <thread>
 
 #include "ortools/constraint_solver/routing_flags.h"
 #include "ortools/constraint_solver/routing_enums.pb.h"
 #include "ortools/constraint_solver/solver_parameters.pb.h"
 #include "ortools/constraint_solver/routing.h"
+#include "ortools/util/range_query_function.h"
+#include "search-telemetry.h"
+#include "time-bucketed-matrix.h"
+
+DEFINE_bool(
+	telemetry, false,
+	"Print search statistics at the end of the search.");
+DEFINE_string(
+	telemetry_file, "",
+	"File the search statistics are written to, as CSV if its name ends in .csv and as JSON otherwise.");
+DEFINE_int64(
+	telemetry_interval, 1000,
+	"Time in milliseconds between two samples of the search statistics.");
+DEFINE_string(
+	profile_file, "",
+	"File the propagation profile of each constraint is written to.");
+DEFINE_int32(
+	random_cities, 0,
+	"Number of cities of a random Euclidean instance. If equal to 0, solve the 13 US cities.");
+DEFINE_int32(
+	seed, 1,
+	"Seed of the random Euclidean instance.");
+DEFINE_bool(
+	decompose, false,
+	"Split the random instance into clusters, solve them in parallel and join their tours.");
+DEFINE_int32(
+	cluster_size, 200,
+	"Number of cities of each cluster when decomposing.");
+DEFINE_int32(
+	threads, 0,
+	"Number of clusters solved at the same time. If equal to 0, one per hardware thread.");
+DEFINE_int32(
+	polish_window, 50,
+	"Number of cities on each side of a cluster boundary that are polished with 2-opt.");
+DEFINE_bool(
+	time_dependent, false,
+	"Minimize the travel time of the tour, the travel time of each arc depending on the hour it is taken.");
+DEFINE_string(
+	td_matrix_file, "tsp-time-buckets.bin",
+	"File of the hourly travel time matrices. It is created from the distances if it does not exist, and "
+	"recreated if it is the default file and was created for another instance.");
+DEFINE_int64(
+	departure_time, 420,
+	"Time the tour leaves the depot, in minutes after midnight of the first day.");
+DEFINE_int64(
+	horizon, 0,
+	"Latest time the tour may return to the depot, in minutes. If equal to 0, the departure time plus "
+	"the longest the tour can take.");
 
 namespace operations_research {
 
@@ -52,6 +108,447 @@ namespace operations_research {
 
 		return (matrix[from.value()][to.value()]);
 	}
+
+	// Cities placed uniformly at random in a 1000 x 1000 square, at rounded
+	// Euclidean distances from each other.
+	class RandomEuclideanInstance {
+	public:
+		RandomEuclideanInstance(int numCities, int seed) : x_(numCities), y_(numCities) {
+			std::mt19937 generator(seed);
+			std::uniform_int_distribution<int> coordinate(0, 1000);
+			for (int i = 0; i < numCities; i++) {
+				x_[i] = coordinate(generator);
+				y_[i] = coordinate(generator);
+			}
+		}
+
+		int64 Distance(RoutingModel::NodeIndex from, RoutingModel::NodeIndex to) {
+			return CityDistance(from.value(), to.value());
+		}
+
+		int64 CityDistance(int from, int to) const {
+			const double dx = x_[from] - x_[to];
+			const double dy = y_[from] - y_[to];
+			return static_cast<int64>(std::round(std::sqrt(dx * dx + dy * dy)));
+		}
+
+		int size() const { return x_.size(); }
+		int x(int city) const { return x_[city]; }
+		int y(int city) const { return y_[city]; }
+
+	private:
+		std::vector<int> x_;
+		std::vector<int> y_;
+	};
+
+	// Distances between a subset of the cities (a cluster, or the cluster
+	// centroids) of a random instance.
+	class SubsetCost {
+	public:
+		SubsetCost(const std::vector<int>& x, const std::vector<int>& y) : x_(x), y_(y) {}
+
+		int64 Distance(RoutingModel::NodeIndex from, RoutingModel::NodeIndex to) {
+			const double dx = x_[from.value()] - x_[to.value()];
+			const double dy = y_[from.value()] - y_[to.value()];
+			return static_cast<int64>(std::round(std::sqrt(dx * dx + dy * dy)));
+		}
+
+	private:
+		const std::vector<int> x_;
+		const std::vector<int> y_;
+	};
+
+	// Solves a TSP on the given points with the routing library and returns
+	// the order in which the tour visits them, starting from the first one.
+	std::vector<int> solveSubsetTsp(const std::vector<int>& x, const std::vector<int>& y) {
+		const int size = x.size();
+		std::vector<int> order(size);
+		for (int i = 0; i < size; i++) {
+			order[i] = i;
+		}
+		// Every tour of three points or less is optimal
+		if (size <= 3) {
+			return order;
+		}
+
+		SubsetCost cost(x, y);
+		RoutingModel routing(size, 1, RoutingModel::NodeIndex(0));
+		routing.SetCost(NewPermanentCallback(&cost, &SubsetCost::Distance));
+
+		RoutingSearchParameters search_parameters = RoutingModel::DefaultSearchParameters();
+		search_parameters.set_first_solution_strategy(
+			FirstSolutionStrategy::PATH_CHEAPEST_ARC);
+
+		const Assignment* solution = routing.SolveWithParameters(search_parameters);
+		if (solution == NULL) {
+			return order;
+		}
+		order.clear();
+		for (int64 index = routing.Start(0); !routing.IsEnd(index);
+			index = solution->Value(routing.NextVar(index))) {
+			order.push_back(routing.IndexToNode(index).value());
+		}
+		return order;
+	}
+
+	// Position of (x, y) along a Hilbert curve filling a side x side grid, side
+	// being a power of two. Cities close on the curve are close in the plane.
+	int64 hilbertIndex(int64 side, int64 x, int64 y) {
+		int64 d = 0;
+		for (int64 s = side / 2; s > 0; s /= 2) {
+			const int64 rx = (x & s) > 0;
+			const int64 ry = (y & s) > 0;
+			d += s * s * ((3 * rx) ^ ry);
+			if (ry == 0) {
+				if (rx == 1) {
+					x = side - 1 - x;
+					y = side - 1 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+
+	int64 tourCost(const RandomEuclideanInstance& instance, const std::vector<int>& tour) {
+		int64 cost = 0;
+		const int size = tour.size();
+		for (int i = 0; i < size; i++) {
+			cost += instance.CityDistance(tour[i], tour[(i + 1) % size]);
+		}
+		return cost;
+	}
+
+	// 2-opt restricted to the positions [first, last] of the tour: reverses
+	// tour[i + 1..j] whenever that shortens it, until no move does.
+	void polishWindow(const RandomEuclideanInstance& instance, int first, int last, std::vector<int>* tour) {
+		std::vector<int>& t = *tour;
+		bool improved = true;
+		while (improved) {
+			improved = false;
+			for (int i = first; i < last; i++) {
+				for (int j = i + 2; j <= last; j++) {
+					const int64 delta = instance.CityDistance(t[i], t[j]) + instance.CityDistance(t[i + 1], t[j + 1])
+						- instance.CityDistance(t[i], t[i + 1]) - instance.CityDistance(t[j], t[j + 1]);
+					if (delta < 0) {
+						std::reverse(t.begin() + i + 1, t.begin() + j + 1);
+						improved = true;
+					}
+				}
+			}
+		}
+	}
+
+	// Decompose-and-stitch for large random instances:
+	// 1. cut the cities into clusters of --cluster_size consecutive cities
+	//    along a Hilbert curve,
+	// 2. solve each cluster as a small routing problem, --threads at a time,
+	// 3. order the clusters with a TSP over their centroids,
+	// 4. open each cluster tour at the edge that best connects it to the
+	//    previous cluster and the next one, and chain them,
+	// 5. polish the --polish_window cities around each boundary with 2-opt.
+	void decomposedTsp() {
+		TelemetryTimers timers;
+		const RandomEuclideanInstance instance(FLAGS_random_cities, FLAGS_seed);
+		const int num_cities = instance.size();
+
+		// 1. Partition
+		ScopedTimer partition_timer(&timers, "partition");
+		std::vector<int64> curve(num_cities);
+		std::vector<int> cities(num_cities);
+		for (int i = 0; i < num_cities; i++) {
+			curve[i] = hilbertIndex(1024, instance.x(i), instance.y(i));
+			cities[i] = i;
+		}
+		std::sort(cities.begin(), cities.end(), [&](int a, int b) { return curve[a] < curve[b]; });
+
+		const int cluster_size = std::max(1, FLAGS_cluster_size);
+		const int num_clusters = (num_cities + cluster_size - 1) / cluster_size;
+		std::vector<std::vector<int>> clusters(num_clusters);
+		for (int i = 0; i < num_cities; i++) {
+			clusters[i / cluster_size].push_back(cities[i]);
+		}
+		partition_timer.stop();
+
+		// 2. Cluster tours, in global city numbers
+		ScopedTimer clusters_timer(&timers, "cluster solves");
+		std::vector<std::vector<int>> cluster_tours(num_clusters);
+		std::atomic<int> next_cluster(0);
+		auto worker = [&]() {
+			for (int c = next_cluster++; c < num_clusters; c = next_cluster++) {
+				std::vector<int> x;
+				std::vector<int> y;
+				for (int city : clusters[c]) {
+					x.push_back(instance.x(city));
+					y.push_back(instance.y(city));
+				}
+				for (int local : solveSubsetTsp(x, y)) {
+					cluster_tours[c].push_back(clusters[c][local]);
+				}
+			}
+		};
+		const int num_threads = FLAGS_threads > 0 ? FLAGS_threads :
+			std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::thread> pool;
+		for (int i = 0; i < std::min(num_threads, num_clusters); i++) {
+			pool.emplace_back(worker);
+		}
+		for (std::thread& thread : pool) {
+			thread.join();
+		}
+		clusters_timer.stop();
+
+		// 3. Cluster order
+		ScopedTimer order_timer(&timers, "cluster order");
+		std::vector<int> centroid_x(num_clusters, 0);
+		std::vector<int> centroid_y(num_clusters, 0);
+		for (int c = 0; c < num_clusters; c++) {
+			int64 sum_x = 0;
+			int64 sum_y = 0;
+			for (int city : clusters[c]) {
+				sum_x += instance.x(city);
+				sum_y += instance.y(city);
+			}
+			centroid_x[c] = sum_x / clusters[c].size();
+			centroid_y[c] = sum_y / clusters[c].size();
+		}
+		const std::vector<int> cluster_order = solveSubsetTsp(centroid_x, centroid_y);
+		order_timer.stop();
+
+		// 4. Stitch
+		ScopedTimer stitch_timer(&timers, "stitch and polish");
+		auto to_centroid = [&](int city, int c) {
+			const double dx = instance.x(city) - centroid_x[c];
+			const double dy = instance.y(city) - centroid_y[c];
+			return static_cast<int64>(std::round(std::sqrt(dx * dx + dy * dy)));
+		};
+
+		std::vector<int> tour;
+		std::vector<int> boundaries;
+		for (int k = 0; k < num_clusters; k++) {
+			const std::vector<int>& cycle = cluster_tours[cluster_order[k]];
+			const int size = cycle.size();
+			const int next = cluster_order[(k + 1) % num_clusters];
+
+			// Open the cycle between cycle[i] and cycle[i + 1], entering at one
+			// end and leaving at the other
+			int best_start = 0;
+			bool best_forward = true;
+			int64 best_cost = kint64max;
+			for (int i = 0; i < size; i++) {
+				const int a = cycle[i];
+				const int b = cycle[(i + 1) % size];
+				const int64 removed = size > 1 ? instance.CityDistance(a, b) : 0;
+				const int64 entry_b = tour.empty() ? 0 : instance.CityDistance(tour.back(), b);
+				const int64 entry_a = tour.empty() ? 0 : instance.CityDistance(tour.back(), a);
+				// Forward: b, ..., a
+				const int64 forward = entry_b + to_centroid(a, next) - removed;
+				// Backward: a, ..., b
+				const int64 backward = entry_a + to_centroid(b, next) - removed;
+				if (forward < best_cost) {
+					best_cost = forward;
+					best_start = (i + 1) % size;
+					best_forward = true;
+				}
+				if (backward < best_cost) {
+					best_cost = backward;
+					best_start = i;
+					best_forward = false;
+				}
+			}
+
+			boundaries.push_back(tour.size());
+			for (int j = 0; j < size; j++) {
+				tour.push_back(cycle[((best_forward ? best_start + j : best_start - j) % size + size) % size]);
+			}
+		}
+		const int64 stitched_cost = tourCost(instance, tour);
+
+		// 5. Polish the boundaries (except where the tour closes, at position 0)
+		const int window = std::max(1, FLAGS_polish_window);
+		for (int boundary : boundaries) {
+			const int first = std::max(0, boundary - window);
+			const int last = std::min(num_cities - 2, boundary + window);
+			if (first + 2 <= last) {
+				polishWindow(instance, first, last, &tour);
+			}
+		}
+		stitch_timer.stop();
+
+		std::cout << "Clusters: " << num_clusters << " of up to " << cluster_size << " cities, "
+			<< std::min(num_threads, num_clusters) << " threads" << std::endl;
+		std::cout << "Cost before polishing: " << stitched_cost << std::endl;
+		std::cout << "Total cost: " << tourCost(instance, tour) << std::endl;
+
+		double elapsed_time = 0;
+		for (const auto& timer : timers.timers()) {
+			std::cout << "Time in " << timer.first << ": " << static_cast<int64>(timer.second)
+				<< " milliseconds." << std::endl;
+			elapsed_time += timer.second;
+		}
+		std::cout << "Total elapsed time: " << static_cast<int64>(elapsed_time) << " milliseconds." << std::endl;
+	}
+
+	// Traffic of each hour of the day, as a percentage of the free-flow travel
+	// time. Hours with the same percentage share one matrix in the file.
+	const int kTrafficPercent[24] = {
+		100, 100, 100, 100, 100, 100, 120, 160, 160, 160, 120, 120,
+		120, 120, 120, 120, 150, 150, 150, 120, 120, 120, 100, 100 };
+
+	// Identifies the instance and traffic the hourly matrices are computed
+	// from (FNV-1a), so that a file written for another one is not used.
+	uint64_t instanceFingerprint(bool random, int size, int seed) {
+		std::vector<int64> values = { random ? 1 : 0, size, random ? seed : 0 };
+		values.insert(values.end(), std::begin(kTrafficPercent), std::end(kTrafficPercent));
+		uint64_t hash = 14695981039346656037ULL;
+		for (const int64 value : values) {
+			for (int byte = 0; byte < 8; byte++) {
+				hash = (hash ^ ((static_cast<uint64_t>(value) >> (8 * byte)) & 0xff)) * 1099511628211ULL;
+			}
+		}
+		return hash;
+	}
+
+	// Writes one travel time matrix per hour, in minutes, driving one unit of
+	// distance a minute in free flow.
+	bool writeHourlyMatrices(const std::string& filename, int size, uint64_t fingerprint,
+		const std::function<int64(int, int)>& free_flow) {
+		TimeBucketedMatrixBuilder builder(size, 60, fingerprint);
+		std::vector<int32_t> matrix(static_cast<size_t>(size) * size);
+		for (int hour = 0; hour < 24; hour++) {
+			for (int from = 0; from < size; from++) {
+				for (int to = 0; to < size; to++) {
+					matrix[static_cast<size_t>(from) * size + to] = (free_flow(from, to) * kTrafficPercent[hour] + 50) / 100;
+				}
+			}
+			builder.addBucket(matrix);
+		}
+		return builder.write(filename);
+	}
+
+	// Travel time of an arc as a function of the time it is taken. It is
+	// constant on each bucket of the matrix and repeats every day, so range
+	// queries walk the buckets of at most one day, reading the mapped matrix,
+	// instead of tabulating the function over the horizon as
+	// MakeStateDependentTransit() does.
+	class BucketedTransit : public RangeIntToIntFunction {
+	public:
+		BucketedTransit(const TimeBucketedMatrix* matrix, int from, int to)
+			: matrix_(matrix), from_(from), to_(to), width_(matrix->bucketWidth()),
+			day_(matrix->bucketWidth() * matrix->numBuckets()) {}
+
+		int64 Query(int64 time) const override {
+			return matrix_->cost(from_, to_, time);
+		}
+
+		int64 RangeMin(int64 from, int64 to) const override {
+			int64 min = kint64max;
+			for (int64 time = from; time < to && time < from + day_; time = nextBucket(time)) {
+				min = std::min(min, Query(time));
+			}
+			return min;
+		}
+
+		int64 RangeMax(int64 from, int64 to) const override {
+			int64 max = kint64min;
+			for (int64 time = from; time < to && time < from + day_; time = nextBucket(time)) {
+				max = std::max(max, Query(time));
+			}
+			return max;
+		}
+
+		int64 RangeFirstInsideInterval(int64 range_begin, int64 range_end,
+			int64 interval_begin, int64 interval_end) const override {
+			for (int64 time = range_begin; time < range_end && time < range_begin + day_; time = nextBucket(time)) {
+				const int64 value = Query(time);
+				if (interval_begin <= value && value < interval_end) {
+					return time;
+				}
+			}
+			return range_end;
+		}
+
+		int64 RangeLastInsideInterval(int64 range_begin, int64 range_end,
+			int64 interval_begin, int64 interval_end) const override {
+			for (int64 time = range_end - 1; time >= range_begin && time > range_end - 1 - day_;
+				time = time / width_ * width_ - 1) {
+				const int64 value = Query(time);
+				if (interval_begin <= value && value < interval_end) {
+					return time;
+				}
+			}
+			return range_begin - 1;
+		}
+
+	private:
+		int64 nextBucket(int64 time) const { return (time / width_ + 1) * width_; }
+
+		const TimeBucketedMatrix* const matrix_;
+		const int from_;
+		const int to_;
+		const int64 width_;
+		const int64 day_;
+	};
+
+	// Arrival time (departure time plus travel time) of an arc. It grows by 1
+	// a minute within a bucket, so it is lowest at the start of a bucket and
+	// highest at its end. Arrivals a day apart differ by a day, so the lowest
+	// one is within a day of the start of the range and the highest one within
+	// a day of its end.
+	class BucketedArrival : public RangeMinMaxIndexFunction {
+	public:
+		BucketedArrival(const BucketedTransit* transit, int64 width, int64 day)
+			: transit_(transit), width_(width), day_(day) {}
+
+		int64 RangeMinArgument(int64 from, int64 to) const override {
+			int64 argument = from;
+			for (int64 time = from; time < to && time < from + day_; time = (time / width_ + 1) * width_) {
+				if (time + transit_->Query(time) < argument + transit_->Query(argument)) {
+					argument = time;
+				}
+			}
+			return argument;
+		}
+
+		int64 RangeMaxArgument(int64 from, int64 to) const override {
+			int64 argument = to - 1;
+			for (int64 time = to - 1; time >= from && time > to - 1 - day_; time = time / width_ * width_ - 1) {
+				if (time + transit_->Query(time) > argument + transit_->Query(argument)) {
+					argument = time;
+				}
+			}
+			return argument;
+		}
+
+	private:
+		const BucketedTransit* const transit_;
+		const int64 width_;
+		const int64 day_;
+	};
+
+	class TimeDependentCost {
+	public:
+		explicit TimeDependentCost(const TimeBucketedMatrix* matrix) : matrix_(matrix) {}
+
+		// The routing model owns, and deletes, the functions of each arc
+		RoutingModel::StateDependentTransit Transit(RoutingModel::NodeIndex from, RoutingModel::NodeIndex to) {
+			BucketedTransit* const transit = new BucketedTransit(matrix_, from.value(), to.value());
+			return { transit, new BucketedArrival(transit, matrix_->bucketWidth(),
+				matrix_->bucketWidth() * matrix_->numBuckets()) };
+		}
+
+	private:
+		const TimeBucketedMatrix* const matrix_;
+	};
+
+	// "day D, HH:MM" of a time in minutes
+	std::string formatTime(int64 time) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "day %d, %02d:%02d", static_cast<int>(time / 1440) + 1,
+			static_cast<int>(time % 1440 / 60), static_cast<int>(time % 60));
+		return buffer;
+	}
+
 	void tsp() {
 		// Let's begin with some data
 		std::vector<std::string> city_names = { "New York", "Los Angeles", "Chicago", "Minneapolis", "Denver", "Dallas", "Seattle",
@@ -60,21 +557,43 @@ namespace operations_research {
 		// TODO: how to read data from a file
 		// TSPLIBReader tsp_data_reader("file-name");
 
+		RoutingModel::NodeIndex depot(3);
+
+		// Or a random instance
+		std::unique_ptr<RandomEuclideanInstance> random_instance;
+		if (FLAGS_random_cities > 0) {
+			random_instance.reset(new RandomEuclideanInstance(FLAGS_random_cities, FLAGS_seed));
+			city_names.clear();
+			for (int i = 0; i < FLAGS_random_cities; i++) {
+				city_names.push_back("City " + std::to_string(i));
+			}
+			depot = RoutingModel::NodeIndex(0);
+		}
+
 		int tsp_size = city_names.size();
 
 		int num_routes = 1; //TSP
 
-		RoutingModel::NodeIndex depot(3);
 
+		const bool telemetryEnabled = FLAGS_telemetry || !FLAGS_telemetry_file.empty();
+		TelemetryTimers timers;
+		TelemetryTimers* const sectionTimers = telemetryEnabled ? &timers : nullptr;
 
 		// Create the routing model
 		if (tsp_size > 0) {
-			RoutingModel routing(tsp_size, num_routes, depot);
+			ScopedTimer modelTimer(sectionTimers, "model");
+
+			RoutingModelParameters model_parameters = RoutingModel::DefaultModelParameters();
+			*model_parameters.mutable_solver_parameters() = telemetryParameters(!FLAGS_profile_file.empty());
+			RoutingModel routing(tsp_size, num_routes, depot, model_parameters);
 
 			RoutingSearchParameters search_parameters = RoutingModel::DefaultSearchParameters();
 
-			// Setting first solution heuristic (cheapest addition).
-			search_parameters.set_first_solution_strategy(
+			// Setting first solution heuristic (cheapest addition). With
+			// --time_dependent the travel times are not arc costs, so the first
+			// solution does without them and local search improves it.
+			search_parameters.set_first_solution_strategy(FLAGS_time_dependent ?
+				FirstSolutionStrategy::FIRST_UNBOUND_MIN_VALUE :
 				FirstSolutionStrategy::PATH_CHEAPEST_ARC);
 
 			// Some local search options
@@ -82,16 +601,93 @@ namespace operations_research {
 			//search_parameters.set_local_search_metaheuristic(LocalSearchMetaheuristic::GUIDED_LOCAL_SEARCH);
 			//search_parameters.set_time_limit_ms(10000);
 
-			search_parameters.set_use_depth_first_search(true);  // Find an optimal solution
+			// Proving optimality is only practical for the 13 cities with arc
+			// costs to bound the search, the other cases stop at the first local
+			// optimum
+			if (random_instance == nullptr && !FLAGS_time_dependent) {
+				search_parameters.set_use_depth_first_search(true);  // Find an optimal solution
+			}
 
 																 //Create the distance callback, which takes two arguments(the from and to node indices)
 																 //and returns the distance between these nodes.
 
-			routing.SetCost(NewPermanentCallback(&distance));
+			// With --time_dependent the travel times depend on the departure
+			// time, so they are read by a time dimension instead of being arc
+			// costs. Its span (the return time minus the departure time) is the
+			// cost of the tour.
+			TimeBucketedMatrix travel_times;
+			std::unique_ptr<TimeDependentCost> time_dependent_cost;
+			RoutingDimension* time_dimension = nullptr;
+			if (FLAGS_time_dependent) {
+				const uint64_t fingerprint = instanceFingerprint(random_instance != nullptr, tsp_size, FLAGS_seed);
+				if (!travel_times.open(FLAGS_td_matrix_file) || travel_times.fingerprint() != fingerprint) {
+					// Only the default file is ours to overwrite
+					if (std::ifstream(FLAGS_td_matrix_file).good() &&
+						!gflags::GetCommandLineFlagInfoOrDie("td_matrix_file").is_default) {
+						std::cout << FLAGS_td_matrix_file << " was not created for this instance" << std::endl;
+						return;
+					}
+					const std::function<int64(int, int)> free_flow = [&](int from, int to) {
+						return random_instance == nullptr ?
+							distance(RoutingModel::NodeIndex(from), RoutingModel::NodeIndex(to)) :
+							random_instance->CityDistance(from, to);
+					};
+					if (!writeHourlyMatrices(FLAGS_td_matrix_file, tsp_size, fingerprint, free_flow) ||
+						!travel_times.open(FLAGS_td_matrix_file)) {
+						std::cout << "Could not write " << FLAGS_td_matrix_file << std::endl;
+						return;
+					}
+				}
+				if (travel_times.numNodes() != tsp_size) {
+					std::cout << FLAGS_td_matrix_file << " has " << travel_times.numNodes() << " cities, not "
+						<< tsp_size << std::endl;
+					return;
+				}
+
+				// The tour leaves every city once, so it takes at most the
+				// slowest arc out of each city at its slowest hour
+				int64 longest_tour = 0;
+				for (int from = 0; from < tsp_size; from++) {
+					int64 slowest = 0;
+					for (int to = 0; to < tsp_size; to++) {
+						for (int bucket = 0; bucket < travel_times.numBuckets(); bucket++) {
+							slowest = std::max<int64>(slowest, travel_times.cost(from, to, bucket * travel_times.bucketWidth()));
+						}
+					}
+					longest_tour += slowest;
+				}
+				const int64 horizon = FLAGS_horizon > 0 ? FLAGS_horizon : FLAGS_departure_time + longest_tour;
+				if (horizon < FLAGS_departure_time) {
+					std::cout << "--horizon is before --departure_time" << std::endl;
+					return;
+				}
+
+				time_dependent_cost.reset(new TimeDependentCost(&travel_times));
+				routing.AddDimensionDependentDimensionWithVehicleCapacity(
+					NewPermanentCallback(time_dependent_cost.get(), &TimeDependentCost::Transit),
+					nullptr, 0, horizon, false, "Time");
+				time_dimension = routing.GetMutableDimension("Time");
+				time_dimension->CumulVar(routing.Start(0))->SetValue(FLAGS_departure_time);
+				time_dimension->SetSpanCostCoefficientForAllVehicles(1);
+			}
+			else if (random_instance == nullptr) {
+				routing.SetCost(NewPermanentCallback(&distance));
+			}
+			else {
+				routing.SetCost(NewPermanentCallback(random_instance.get(), &RandomEuclideanInstance::Distance));
+			}
 
+			TelemetryMonitor* telemetry = nullptr;
+			if (telemetryEnabled) {
+				telemetry = makeTelemetryMonitor(routing.solver(), FLAGS_telemetry_interval);
+				routing.AddSearchMonitor(telemetry);
+			}
+			modelTimer.stop();
 
 			// Getting the solution
+			ScopedTimer searchTimer(sectionTimers, "search");
 			const Assignment * solution = routing.SolveWithParameters(search_parameters);
+			searchTimer.stop();
 
 			//  Solution inspection
 			if (solution != NULL) {
@@ -101,14 +697,40 @@ namespace operations_research {
 
 					for (int64 index = routing.Start(route_number); !routing.IsEnd(index);
 						index = solution->Value(routing.NextVar(index))) {
-						std::cout << city_names[routing.IndexToNode(index).value()] << " -> ";
+						std::cout << city_names[routing.IndexToNode(index).value()];
+						if (time_dimension != nullptr) {
+							std::cout << " (" << formatTime(solution->Value(time_dimension->CumulVar(index))) << ")";
+						}
+						std::cout << " -> ";
+					}
+					std::cout << city_names[routing.IndexToNode(routing.Start(route_number)).value()];
+					if (time_dimension != nullptr) {
+						std::cout << " (" << formatTime(solution->Value(time_dimension->CumulVar(routing.End(route_number)))) << ")";
 					}
-					std::cout << city_names[routing.IndexToNode(routing.Start(route_number)).value()] << std::endl;
+					std::cout << std::endl;
+				}
+				if (time_dimension != nullptr) {
+					std::cout << "Total travel time: " << solution->Value(time_dimension->CumulVar(routing.End(0)))
+						- FLAGS_departure_time << " minutes, "
+						<< travel_times.numSlabs() << " distinct matrices for " << travel_times.numBuckets() << " hours" << std::endl;
 				}
 			}
 			else {
 				std::cout << "No solution found" << std::endl;
 			}
+
+			const int64 elapsedTime = routing.solver()->wall_time();
+			std::cout << "Total elapsed time: " << elapsedTime << " milliseconds." << std::endl;
+
+			if (telemetry != nullptr) {
+				telemetry->printSummary();
+				if (!FLAGS_telemetry_file.empty() && !telemetry->write(FLAGS_telemetry_file, &timers)) {
+					std::cout << "Could not write " << FLAGS_telemetry_file << std::endl;
+				}
+			}
+			if (!FLAGS_profile_file.empty()) {
+				routing.solver()->ExportProfilingOverview(FLAGS_profile_file);
+			}
 		}
 	}
 
@@ -116,6 +738,23 @@ namespace operations_research {
 
 int main(int argc, char** argv) {
 	gflags::ParseCommandLineFlags(&argc, &argv, true);
-	operations_research::tsp();
+	if (FLAGS_time_dependent && FLAGS_departure_time < 0) {
+		std::cout << "--departure_time must be at least 0" << std::endl;
+		return 1;
+	}
+	if (FLAGS_decompose) {
+		if (FLAGS_random_cities <= 0) {
+			std::cout << "--decompose needs the coordinates of a --random_cities instance" << std::endl;
+			return 1;
+		}
+		if (FLAGS_time_dependent) {
+			std::cout << "--decompose does not support --time_dependent" << std::endl;
+			return 1;
+		}
+		operations_research::decomposedTsp();
+	}
+	else {
+		operations_research::tsp();
+	}
 	getchar();
 }
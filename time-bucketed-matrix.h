@@ -0,0 +1,184 @@
+//Copyright 2018 Maria Andreina Francisco Rodriguez (andreina@comp.nus.edu.sg)
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http ://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+
+// Time-dependent travel costs.
+//
+// The day is cut into buckets of equal width, each with its own cost matrix.
+// Buckets with the same matrix (e.g. every night hour) share it, so the file
+// holds one slab per distinct matrix, stored as one contiguous 3-D array
+// [slab][from][to] that is memory-mapped rather than read. cost() looks up the
+// bucket of the departure time and then the arc, in constant time. Times past
+// the last bucket wrap around, so the buckets of a day repeat every day.
+//
+// The fingerprint is chosen by the writer to identify the instance the
+// matrices were computed from, so that a reader can tell a stale file from
+// its own.
+//
+// File layout (little-endian):
+//   char[4]  magic "TDMX"
+//   uint32   version
+//   uint32   number of nodes n
+//   uint32   number of buckets
+//   uint32   number of slabs
+//   uint32   unused
+//   int64    bucket width
+//   uint64   fingerprint
+//   uint32   slab of each bucket, padded to a multiple of 8 bytes
+//   int32    slabs[number of slabs][n][n]
+
+#ifndef TIME_BUCKETED_MATRIX_H
+#define TIME_BUCKETED_MATRIX_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mapped-file.h"
+
+namespace operations_research {
+
+	const char kTimeBucketedMatrixMagic[4] = { 'T', 'D', 'M', 'X' };
+	const uint32_t kTimeBucketedMatrixVersion = 2;
+	const size_t kTimeBucketedMatrixHeaderSize = 40;
+	// Bounds the size of a slab, so that its offsets cannot overflow
+	const int kTimeBucketedMatrixMaxNodes = 1 << 16;
+
+	// Collects the matrix of each bucket, in order, and writes them to a file.
+	class TimeBucketedMatrixBuilder {
+	public:
+		TimeBucketedMatrixBuilder(int numNodes, int64_t bucketWidth, uint64_t fingerprint)
+			: numNodes_(numNodes), bucketWidth_(bucketWidth), fingerprint_(fingerprint) {}
+
+		// matrix[from * numNodes + to] is the cost of leaving from for to
+		// during the bucket. A matrix equal to an earlier one is not stored again.
+		void addBucket(const std::vector<int32_t>& matrix) {
+			const size_t slabSize = static_cast<size_t>(numNodes_) * numNodes_;
+			const size_t numSlabs = slabs_.size() / slabSize;
+			for (size_t slab = 0; slab < numSlabs; slab++) {
+				if (std::memcmp(&slabs_[slab * slabSize], matrix.data(), slabSize * sizeof(int32_t)) == 0) {
+					slabOfBucket_.push_back(slab);
+					return;
+				}
+			}
+			slabs_.insert(slabs_.end(), matrix.begin(), matrix.begin() + slabSize);
+			slabOfBucket_.push_back(numSlabs);
+		}
+
+		bool write(const std::string& filename) const {
+			const size_t slabSize = static_cast<size_t>(numNodes_) * numNodes_;
+			const uint32_t header[5] = { kTimeBucketedMatrixVersion, static_cast<uint32_t>(numNodes_),
+				static_cast<uint32_t>(slabOfBucket_.size()), static_cast<uint32_t>(slabs_.size() / slabSize), 0 };
+			std::vector<uint32_t> index(slabOfBucket_);
+			index.resize((index.size() + 1) / 2 * 2, 0);
+
+			std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+			out.write(kTimeBucketedMatrixMagic, sizeof(kTimeBucketedMatrixMagic));
+			out.write(reinterpret_cast<const char*>(header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(&bucketWidth_), sizeof(bucketWidth_));
+			out.write(reinterpret_cast<const char*>(&fingerprint_), sizeof(fingerprint_));
+			out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint32_t));
+			out.write(reinterpret_cast<const char*>(slabs_.data()), slabs_.size() * sizeof(int32_t));
+			return static_cast<bool>(out);
+		}
+
+	private:
+		const int numNodes_;
+		const int64_t bucketWidth_;
+		const uint64_t fingerprint_;
+		std::vector<uint32_t> slabOfBucket_;
+		std::vector<int32_t> slabs_;
+	};
+
+	// Read-only, memory-mapped view of a file written by the builder.
+	class TimeBucketedMatrix {
+	public:
+		TimeBucketedMatrix() {}
+
+		TimeBucketedMatrix(const TimeBucketedMatrix&) = delete;
+		TimeBucketedMatrix& operator=(const TimeBucketedMatrix&) = delete;
+
+		bool open(const std::string& filename) {
+			close();
+			if (!file_.open(filename) || file_.size() < kTimeBucketedMatrixHeaderSize ||
+				std::memcmp(file_.data(), kTimeBucketedMatrixMagic, sizeof(kTimeBucketedMatrixMagic)) != 0) {
+				close();
+				return false;
+			}
+
+			uint32_t header[5];
+			std::memcpy(header, file_.data() + 4, sizeof(header));
+			std::memcpy(&bucketWidth_, file_.data() + 24, sizeof(bucketWidth_));
+			std::memcpy(&fingerprint_, file_.data() + 32, sizeof(fingerprint_));
+			numNodes_ = header[1];
+			const uint32_t numBuckets = header[2];
+			numSlabs_ = header[3];
+			if (header[0] != kTimeBucketedMatrixVersion || numNodes_ <= 0 || numNodes_ > kTimeBucketedMatrixMaxNodes ||
+				numBuckets == 0 || bucketWidth_ <= 0) {
+				close();
+				return false;
+			}
+
+			// Offsets, not pointers, are checked against the size of the file
+			const size_t slabSize = static_cast<size_t>(numNodes_) * numNodes_;
+			const size_t slabsOffset = kTimeBucketedMatrixHeaderSize + (static_cast<size_t>(numBuckets) + 1) / 2 * 2 * sizeof(uint32_t);
+			if (slabsOffset > file_.size() || numSlabs_ > (file_.size() - slabsOffset) / (slabSize * sizeof(int32_t))) {
+				close();
+				return false;
+			}
+			const uint32_t* const index = reinterpret_cast<const uint32_t*>(file_.data() + kTimeBucketedMatrixHeaderSize);
+			const int32_t* const slabs = reinterpret_cast<const int32_t*>(file_.data() + slabsOffset);
+
+			// One pointer per bucket saves looking up its slab on every cost()
+			buckets_.resize(numBuckets);
+			for (uint32_t bucket = 0; bucket < numBuckets; bucket++) {
+				if (index[bucket] >= numSlabs_) {
+					close();
+					return false;
+				}
+				buckets_[bucket] = slabs + index[bucket] * slabSize;
+			}
+			return true;
+		}
+
+		void close() {
+			file_.close();
+			buckets_.clear();
+		}
+
+		int numNodes() const { return numNodes_; }
+		int numBuckets() const { return buckets_.size(); }
+		int numSlabs() const { return numSlabs_; }
+		int64_t bucketWidth() const { return bucketWidth_; }
+		uint64_t fingerprint() const { return fingerprint_; }
+
+		// Cost of leaving from for to at the given time (time >= 0)
+		int32_t cost(int from, int to, int64_t time) const {
+			const int64_t bucket = (time / bucketWidth_) % static_cast<int64_t>(buckets_.size());
+			return buckets_[bucket][static_cast<size_t>(from) * numNodes_ + to];
+		}
+
+	private:
+		MappedFile file_;
+		std::vector<const int32_t*> buckets_;
+		int numNodes_ = 0;
+		uint32_t numSlabs_ = 0;
+		int64_t bucketWidth_ = 0;
+		uint64_t fingerprint_ = 0;
+	};
+
+} // namespace operations_research
+
+#endif // TIME_BUCKETED_MATRIX_H